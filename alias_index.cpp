@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "alias_index.h"
+
+// Number of seeds to try per bucket before giving up
+#define ALIAS_MAX_SEED  (1u << 20)
+
+// FNV-1a with seed mixed into offset basis
+static inline uint64_t Hash(const char* data, size_t len, uint64_t seed)
+{
+    uint64_t h = 0xcbf29ce484222325ull ^ (seed * 0x9e3779b97f4a7c15ull);
+    for (size_t i = 0; i < len; ++i) {
+        h ^= (unsigned char)data[i];
+        h *= 0x100000001b3ull;
+    }
+
+    // Final avalanche so that low bits depend on all input
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    return h;
+}
+
+int AliasIndex::build(const std::vector<Alias>& aliases)
+{
+    m_seeds.clear();
+    m_slots.clear();
+    m_names.clear();
+
+    size_t count = aliases.size();
+    if (count == 0) {
+        return 0;
+    }
+
+    // Identical names would never land in distinct slots
+    std::vector<const std::string*> names;
+    for (const Alias& alias : aliases) {
+        names.push_back(&alias.first);
+    }
+
+    std::sort(names.begin(), names.end(), [](const std::string* a, const std::string* b) { return *a < *b; });
+    for (size_t i = 1; i < names.size(); ++i) {
+        if (*names[i] == *names[i - 1]) {
+            fprintf(stderr, "Duplicate alias '%s'\n", names[i]->c_str());
+            return -1;
+        }
+    }
+
+    // Average bucket size of 4 keeps build fast and seed table small
+    size_t nbuckets = (count + 3) / 4;
+    std::vector<std::vector<size_t>> buckets(nbuckets);
+    for (size_t i = 0; i < count; ++i) {
+        const std::string& name = aliases[i].first;
+        buckets[Hash(name.data(), name.size(), 0) % nbuckets].push_back(i);
+    }
+
+    // Place largest buckets first while there is still room
+    std::vector<size_t> order(nbuckets);
+    for (size_t i = 0; i < nbuckets; ++i) {
+        order[i] = i;
+    }
+
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return buckets[a].size() > buckets[b].size();
+    });
+
+    std::vector<bool> taken(count, false);
+    std::vector<size_t> placement(count);
+    std::vector<size_t> slots;
+    m_seeds.assign(nbuckets, 0);
+
+    for (size_t b : order) {
+        const std::vector<size_t>& keys = buckets[b];
+        if (keys.empty()) {
+            break;
+        }
+
+        uint32_t seed = 1;
+        for (; seed < ALIAS_MAX_SEED; ++seed) {
+            slots.clear();
+            for (size_t key : keys) {
+                const std::string& name = aliases[key].first;
+                size_t slot = Hash(name.data(), name.size(), seed) % count;
+                if (taken[slot] || std::find(slots.begin(), slots.end(), slot) != slots.end()) {
+                    break;
+                }
+
+                slots.push_back(slot);
+            }
+
+            if (slots.size() == keys.size()) {
+                break;
+            }
+        }
+
+        if (seed == ALIAS_MAX_SEED) {
+            fprintf(stderr, "Failed to place alias '%s'\n", aliases[keys[0]].first.c_str());
+            m_seeds.clear();
+            return -1;
+        }
+
+        m_seeds[b] = seed;
+        for (size_t i = 0; i < keys.size(); ++i) {
+            taken[slots[i]] = true;
+            placement[keys[i]] = slots[i];
+        }
+    }
+
+    m_slots.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        Slot& slot = m_slots[placement[i]];
+        slot.offset = m_names.size();
+        slot.length = aliases[i].first.size();
+        slot.id = aliases[i].second;
+        m_names.append(aliases[i].first);
+    }
+
+    return 0;
+}
+
+bool AliasIndex::lookup(const char* name, size_t len, uint32_t& id) const
+{
+    if (m_slots.empty()) {
+        return false;
+    }
+
+    uint32_t seed = m_seeds[Hash(name, len, 0) % m_seeds.size()];
+    const Slot& slot = m_slots[Hash(name, len, seed) % m_slots.size()];
+    if (slot.length != len || 0 != memcmp(m_names.data() + slot.offset, name, len)) {
+        return false;
+    }
+
+    id = slot.id;
+    return true;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * \brief   Immutable LED name to address index.
+ *          Built once at startup into a minimal perfect hash (hash and displace):
+ *          names are hashed into buckets, every bucket gets a seed which places all of its names
+ *          into distinct slots. Lookup is two hashes and a single name comparison.
+ */
+class AliasIndex
+{
+public:
+
+    typedef std::pair<std::string, uint32_t> Alias;
+
+    AliasIndex() {
+    }
+
+    /**
+     * \brief   Build index from name/address pairs
+     *
+     * \return  0 on success, negative value on error (e.g. duplicate names)
+     */
+    int build(const std::vector<Alias>& aliases);
+
+    /**
+     * \brief   Find LED address by name
+     *
+     * \return  True if name is known
+     */
+    bool lookup(const char* name, size_t len, uint32_t& id) const;
+
+    bool lookup(const std::string& name, uint32_t& id) const {
+        return this->lookup(name.data(), name.size(), id);
+    }
+
+    size_t size() const {
+        return m_slots.size();
+    }
+
+private:
+
+    struct Slot
+    {
+        uint32_t offset;    // Name offset in m_names
+        uint32_t length;    // Name length
+        uint32_t id;        // LED address
+    };
+
+    std::vector<uint32_t> m_seeds;  // Per bucket displacement seed
+    std::vector<Slot> m_slots;
+    std::string m_names;            // All names back to back
+};
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "ledsrv.h"
+
+/**
+ * \brief   Helpers shared by benchmark drivers.
+ *          Drivers talk to a server instance started by their wrapper script, see bench_*.sh.
+ */
+
+/**
+ * \brief   Listener fifo of server instance, default listener for NULL or empty instance
+ */
+static inline std::string ServerFifo(const char* instance)
+{
+    std::string name(LEDSRV_FIFO_NAME);
+    if (instance && *instance) {
+        name = name + "." + instance;
+    }
+
+    return name;
+}
+
+/**
+ * \brief   CPU time, user and system, consumed by a process so far
+ *
+ * \return  Microseconds, 0 if process is not there
+ */
+static inline uint64_t ProcessCpuUsec(pid_t pid)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        return 0;
+    }
+
+    // Command name may contain spaces, fields are counted from its closing parenthesis
+    char buf[1024];
+    size_t len = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    buf[len] = '\0';
+
+    unsigned long long utime = 0;
+    unsigned long long stime = 0;
+    const char* p = strrchr(buf, ')');
+    if (!p || sscanf(p + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu", &utime, &stime) != 2) {
+        return 0;
+    }
+
+    return (utime + stime) * 1000000 / sysconf(_SC_CLK_TCK);
+}
+
+/**
+ * \brief   CPU time consumed by calling process so far, microseconds
+ */
+static inline uint64_t SelfCpuUsec(void)
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return (uint64_t)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000 + ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+}
+
+/**
+ * \brief   Resident set size of a process, kilobytes
+ *
+ * \return  VmRSS, 0 if process is not there
+ */
+static inline uint64_t ProcessRssKb(pid_t pid)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/status", (int)pid);
+
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        return 0;
+    }
+
+    char line[256];
+    unsigned long long rss = 0;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "VmRSS: %llu kB", &rss) == 1) {
+            break;
+        }
+    }
+
+    fclose(f);
+    return rss;
+}
+
+/**
+ * \brief   Sample at fraction p of sorted samples, sorts them in place
+ */
+static inline uint64_t Percentile(std::vector<uint64_t>& samples, double p)
+{
+    if (samples.empty()) {
+        return 0;
+    }
+
+    std::sort(samples.begin(), samples.end());
+    size_t i = std::min(samples.size() - 1, (size_t)(p * samples.size()));
+    return samples[i];
+}
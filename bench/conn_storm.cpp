@@ -0,0 +1,105 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ledclient.h"
+#include "wait_policy.h"
+#include "bench.h"
+
+// Burst of clients connecting at once, each served its first request, run by bench_storm.sh
+static void usage(const char* name)
+{
+    printf("%s: [-i instance] [-n clients] [-t timeout_ms]\n", name);
+    printf(" -i    Server instance\n");
+    printf(" -n    Number of clients connecting at once (default 200)\n");
+    printf(" -t    Connect and response timeout in milliseconds (default 5000)\n");
+}
+
+int main(int argc, char* argv[])
+{
+    const char* instance = NULL;
+    size_t count = 200;
+    int timeoutMs = 5000;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "i:n:t:h")) != -1) {
+        switch (opt) {
+        case 'i':
+            instance = optarg;
+            break;
+        case 'n':
+            count = std::max(1ul, strtoul(optarg, NULL, 10));
+            break;
+        case 't':
+            timeoutMs = strtol(optarg, NULL, 10);
+            break;
+        default:
+            usage(argv[0]);
+            return (opt == 'h') ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    std::string server = ServerFifo(instance);
+    std::vector<uint64_t> latency(count);
+    std::atomic<size_t> busy(0);
+    std::atomic<size_t> failed(0);
+
+    // Clients are released together once all threads are up
+    std::mutex lock;
+    std::condition_variable go;
+    bool started = false;
+    uint64_t start = 0;
+
+    std::vector<std::thread> clients;
+    for (size_t i = 0; i < count; ++i) {
+        clients.emplace_back([&, i]() {
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                go.wait(guard, [&]() { return started; });
+            }
+
+            LedClient client;
+            std::string response;
+            int res = client.connect(timeoutMs, server.c_str());
+            if (res == 0) {
+                res = client.request("get-led-state 0", response, timeoutMs);
+            }
+
+            // Shed request still got its answer, it's the connection we're timing
+            if (res == LedClient::kBusy) {
+                ++busy;
+            } else if (res != LedClient::kOk) {
+                ++failed;
+            }
+
+            latency[i] = MonotonicUsec() - start;
+        });
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        started = true;
+        start = MonotonicUsec();
+    }
+
+    go.notify_all();
+    for (auto& t : clients) {
+        t.join();
+    }
+
+    uint64_t all = Percentile(latency, 1.0);
+    uint64_t p50 = Percentile(latency, 0.50);
+    uint64_t p99 = Percentile(latency, 0.99);
+    printf("%zu clients: all served in %llu us, first response p50 %llu us, p99 %llu us, %zu busy, %zu failed\n",
+           count, (unsigned long long)all, (unsigned long long)p50, (unsigned long long)p99, busy.load(), failed.load());
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,88 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ledclient.h"
+#include "bench.h"
+
+// Server memory held by idle connections, run by bench_idle.sh
+static void usage(const char* name)
+{
+    printf("%s: -p server_pid [-i instance] [-n connections]\n", name);
+    printf(" -p    Server process, its RSS is sampled before and after connecting\n");
+    printf(" -i    Server instance\n");
+    printf(" -n    Number of idle connections (default 2000)\n");
+}
+
+int main(int argc, char* argv[])
+{
+    pid_t server = 0;
+    const char* instance = NULL;
+    size_t count = 2000;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "p:i:n:h")) != -1) {
+        switch (opt) {
+        case 'p':
+            server = strtol(optarg, NULL, 10);
+            break;
+        case 'i':
+            instance = optarg;
+            break;
+        case 'n':
+            count = std::max(1ul, strtoul(optarg, NULL, 10));
+            break;
+        default:
+            usage(argv[0]);
+            return (opt == 'h') ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    if (server <= 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::string fifo = ServerFifo(instance);
+    std::string response;
+
+    // Warm up every worker once, so that baseline holds their first session chunks and stacks
+    std::vector<std::unique_ptr<LedClient>> clients;
+    for (size_t i = 0; i < 64; ++i) {
+        LedClient client;
+        if (client.connect(1000, fifo.c_str()) == 0) {
+            client.request("get-led-state 0", response, 1000);
+        }
+    }
+
+    usleep(100000);
+    uint64_t before = ProcessRssKb(server);
+
+    // Every connection is served one request, so server side is fully set up before it goes idle
+    for (size_t i = 0; i < count; ++i) {
+        clients.emplace_back(new LedClient());
+        int res = clients.back()->connect(1000, fifo.c_str());
+        if (res == 0) {
+            res = clients.back()->request("get-led-state 0", response, 1000);
+        }
+
+        if (res < 0) {
+            fprintf(stderr, "Connection %zu failed: %s\n", i, strerror(-res));
+            return EXIT_FAILURE;
+        }
+    }
+
+    usleep(100000);
+    uint64_t after = ProcessRssKb(server);
+
+    printf("%zu idle connections: server RSS %llu kB -> %llu kB, %.0f bytes per connection\n",
+           count, (unsigned long long)before, (unsigned long long)after,
+           (after > before) ? (double)(after - before) * 1024 / count : 0.0);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,107 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include <boost/algorithm/string.hpp>
+
+#include "json_protocol.h"
+#include "wait_policy.h"
+#include "bench.h"
+
+// Request parsing and response formatting of JSON-lines protocol against text protocol, run by make bench-json
+static void usage(const char* name)
+{
+    printf("%s: [-n rounds]\n", name);
+    printf(" -n    Rounds over the request set (default 200000)\n");
+}
+
+// Same requests in both protocols, line for line
+static const char* kTextRequests[] = {
+    "get-led-state 12",
+    "set-led-state 12 on",
+    "set-led-color kitchen blue",
+    "set-led-rate 7 2.5",
+    "get-led-lit 300",
+};
+
+static const char* kJsonRequests[] = {
+    "{\"cmd\":\"get-led-state\",\"led\":12,\"id\":1}",
+    "{\"cmd\":\"set-led-state\",\"led\":12,\"args\":[\"on\"],\"id\":2}",
+    "{\"cmd\":\"set-led-color\",\"led\":\"kitchen\",\"args\":[\"blue\"],\"id\":\"k\"}",
+    "{\"cmd\":\"set-led-rate\",\"led\":7,\"args\":[2.5],\"id\":4}",
+    "{\"cmd\":\"get-led-lit\",\"led\":300,\"id\":5}",
+};
+
+int main(int argc, char* argv[])
+{
+    size_t rounds = 200000;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:h")) != -1) {
+        switch (opt) {
+        case 'n':
+            rounds = std::max(1ul, strtoul(optarg, NULL, 10));
+            break;
+        default:
+            usage(argv[0]);
+            return (opt == 'h') ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    const size_t count = sizeof(kTextRequests) / sizeof(kTextRequests[0]);
+    std::vector<std::string> text(kTextRequests, kTextRequests + count);
+    std::vector<std::string> json(kJsonRequests, kJsonRequests + count);
+    std::string value("on");
+    std::string output;
+    size_t args = 0;
+
+    // Text path as served by worker: split on spaces, status line
+    std::vector<std::string> argvText;
+    uint64_t start = MonotonicUsec();
+    for (size_t r = 0; r < rounds; ++r) {
+        for (const std::string& req : text) {
+            boost::split(argvText, req, boost::is_space());
+            args += argvText.size();
+
+            output.clear();
+            output.append(LEDSRV_STATUS_OK " ");
+            output.append(value);
+            output.append("\n");
+        }
+    }
+
+    uint64_t textUsec = MonotonicUsec() - start;
+
+    // JSON path parses in place, so every request starts from a fresh copy like a freshly read line
+    JsonRequest parsed;
+    std::string line;
+    start = MonotonicUsec();
+    for (size_t r = 0; r < rounds; ++r) {
+        for (const std::string& req : json) {
+            line = req;
+            if (!ParseJsonRequest(line, parsed)) {
+                fprintf(stderr, "Failed to parse %s\n", req.c_str());
+                return EXIT_FAILURE;
+            }
+
+            args += parsed.commands[0].size();
+
+            output.clear();
+            output.append("{\"id\":");
+            output.append(parsed.id);
+            output.append(",");
+            JsonAppendResult(output, true, value);
+            output.append("}\n");
+        }
+    }
+
+    uint64_t jsonUsec = MonotonicUsec() - start;
+
+    double total = (double)rounds * count;
+    printf("text %.0f ns/request, json %.0f ns/request (%zu arguments)\n",
+           textUsec * 1000 / total, jsonUsec * 1000 / total, args);
+    return EXIT_SUCCESS;
+}
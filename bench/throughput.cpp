@@ -0,0 +1,110 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ledclient.h"
+#include "wait_policy.h"
+#include "bench.h"
+
+// Sustained request rate of concurrent pipelining clients, run by bench_numa.sh
+static void usage(const char* name)
+{
+    printf("%s: [-p server_pid] [-i instance] [-n clients] [-b batch] [-d duration_ms]\n", name);
+    printf(" -p    Server process, its CPU time per request is reported when given\n");
+    printf(" -i    Server instance\n");
+    printf(" -n    Number of client connections, each on its own thread (default 8)\n");
+    printf(" -b    Requests pipelined in one write (default 32)\n");
+    printf(" -d    Duration in milliseconds (default 2000)\n");
+}
+
+int main(int argc, char* argv[])
+{
+    pid_t server = 0;
+    const char* instance = NULL;
+    size_t count = 8;
+    size_t batch = 32;
+    unsigned durationMs = 2000;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "p:i:n:b:d:h")) != -1) {
+        switch (opt) {
+        case 'p':
+            server = strtol(optarg, NULL, 10);
+            break;
+        case 'i':
+            instance = optarg;
+            break;
+        case 'n':
+            count = std::max(1ul, strtoul(optarg, NULL, 10));
+            break;
+        case 'b':
+            batch = std::max(1ul, strtoul(optarg, NULL, 10));
+            break;
+        case 'd':
+            durationMs = strtoul(optarg, NULL, 10);
+            break;
+        default:
+            usage(argv[0]);
+            return (opt == 'h') ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    std::string fifo = ServerFifo(instance);
+    std::atomic<uint64_t> served(0);
+    std::atomic<uint64_t> failed(0);
+    std::atomic<bool> stop(false);
+
+    uint64_t serverCpu = server ? ProcessCpuUsec(server) : 0;
+    uint64_t start = MonotonicUsec();
+
+    // Every client writes its own LEDs, so that clients don't just read a single cached LED
+    std::vector<std::thread> clients;
+    for (size_t c = 0; c < count; ++c) {
+        clients.emplace_back([&, c]() {
+            LedClient client;
+            if (client.connect(1000, fifo.c_str()) != 0) {
+                ++failed;
+                return;
+            }
+
+            std::vector<std::string> reqs;
+            for (size_t i = 0; i < batch; ++i) {
+                std::string led = std::to_string(c * batch + i / 2);
+                reqs.push_back((i % 2) ? "get-led-state " + led : "set-led-state " + led + " on");
+            }
+
+            while (!stop) {
+                size_t rejected = 0;
+                if (client.pipeline(reqs, rejected, 1000) != 0) {
+                    ++failed;
+                    return;
+                }
+
+                served += batch - rejected;
+            }
+        });
+    }
+
+    usleep(durationMs * 1000);
+    stop = true;
+    for (auto& t : clients) {
+        t.join();
+    }
+
+    uint64_t elapsed = MonotonicUsec() - start;
+    uint64_t total = served.load();
+    printf("%zu clients, batch %zu: %.0f requests/s", count, batch, (double)total * 1000000 / elapsed);
+    if (server && total > 0) {
+        printf(", server cpu %.2f us/request", (double)(ProcessCpuUsec(server) - serverCpu) / total);
+    }
+
+    printf(", %llu clients failed\n", (unsigned long long)failed.load());
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,111 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "ledclient.h"
+#include "wait_policy.h"
+#include "bench.h"
+
+// Paced request latency against CPU burnt by server and client, run by bench_wait.sh
+static void usage(const char* name)
+{
+    printf("%s: -p server_pid [-i instance] [-n requests] [-g gap_usec] [-s spin_usec]\n", name);
+    printf(" -p    Server process, its CPU time is sampled before and after the run\n");
+    printf(" -i    Server instance\n");
+    printf(" -n    Number of requests (default 2000)\n");
+    printf(" -g    Gap between request starts in microseconds (default 500)\n");
+    printf(" -s    Client response spin budget in microseconds (default 0)\n");
+}
+
+// Sleep until absolute monotonic time in microseconds
+static void SleepUntil(uint64_t usec)
+{
+    struct timespec ts;
+    ts.tv_sec = usec / 1000000;
+    ts.tv_nsec = (usec % 1000000) * 1000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    pid_t server = 0;
+    const char* instance = NULL;
+    size_t count = 2000;
+    unsigned gapUsec = 500;
+    unsigned spinUsec = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "p:i:n:g:s:h")) != -1) {
+        switch (opt) {
+        case 'p':
+            server = strtol(optarg, NULL, 10);
+            break;
+        case 'i':
+            instance = optarg;
+            break;
+        case 'n':
+            count = std::max(1ul, strtoul(optarg, NULL, 10));
+            break;
+        case 'g':
+            gapUsec = strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            spinUsec = strtoul(optarg, NULL, 10);
+            break;
+        default:
+            usage(argv[0]);
+            return (opt == 'h') ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    if (server <= 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    LedClient client(spinUsec);
+    int err = client.connect(1000, ServerFifo(instance).c_str());
+    if (err != 0) {
+        fprintf(stderr, "Failed to connect: %s\n", strerror(-err));
+        return EXIT_FAILURE;
+    }
+
+    std::vector<uint64_t> latency;
+    latency.reserve(count);
+
+    std::string response;
+    uint64_t serverCpu = ProcessCpuUsec(server);
+    uint64_t clientCpu = SelfCpuUsec();
+    uint64_t next = MonotonicUsec();
+
+    for (size_t i = 0; i < count; ++i) {
+        SleepUntil(next);
+        next += gapUsec;
+
+        uint64_t start = MonotonicUsec();
+        int res = client.request("get-led-state 0", response);
+        if (res < 0) {
+            fprintf(stderr, "Request failed: %s\n", strerror(-res));
+            return EXIT_FAILURE;
+        }
+
+        latency.push_back(MonotonicUsec() - start);
+    }
+
+    serverCpu = ProcessCpuUsec(server) - serverCpu;
+    clientCpu = SelfCpuUsec() - clientCpu;
+
+    uint64_t p50 = Percentile(latency, 0.50);
+    uint64_t p99 = Percentile(latency, 0.99);
+    printf("client spin %u us: p50 %llu us, p99 %llu us, server cpu %.1f us/request, client cpu %.1f us/request\n",
+           spinUsec, (unsigned long long)p50, (unsigned long long)p99,
+           (double)serverCpu / count, (double)clientCpu / count);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,30 @@
+#!/bin/bash
+
+# Server RSS per idle connection, CLIENTS connections are opened and left idle.
+# Extra arguments are passed to ledsrv, e.g. -w workers.
+CLIENTS=${CLIENTS:-2000}
+DIR=$(dirname $0)
+INSTANCE=bench.$$
+LISTENER=/tmp/ledsrv.$INSTANCE
+
+# Every connection is a fifo pair open on both sides
+ulimit -n $((CLIENTS * 4 + 256)) 2> /dev/null || echo "$0: can't raise open files limit, expect failures" >&2
+
+$DIR/ledsrv -i $INSTANCE "$@" > /dev/null &
+server=$!
+
+while [[ ! -p $LISTENER ]]; do
+    if ! kill -0 $server 2> /dev/null; then
+        echo "$0: ledsrv exited" >&2;
+        exit 1;
+    fi
+    sleep 0.01
+done
+
+$DIR/bench/idle_rss -p $server -i $INSTANCE -n $CLIENTS
+res=$?
+
+kill $server
+wait $server 2> /dev/null
+rm -f $LISTENER
+exit $res
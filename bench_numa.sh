@@ -0,0 +1,46 @@
+#!/bin/bash
+
+# Request throughput with workers and their memory placed on NUMA nodes against kernel placement.
+# Without placement, memory is interleaved over all nodes when numactl is there.
+# Extra arguments are passed to the driver, e.g. -n clients.
+DIR=$(dirname $0)
+
+nodes=$(ls -d /sys/devices/system/node/node[0-9]* 2> /dev/null | wc -l)
+echo "$((nodes > 0 ? nodes : 1)) NUMA nodes"
+
+interleave=
+if command -v numactl > /dev/null; then
+    interleave="numactl --interleave=all"
+fi
+
+for placement in local interleaved; do
+    INSTANCE=bench.$$.$placement
+    LISTENER=/tmp/ledsrv.$INSTANCE
+
+    if [[ $placement == local ]]; then
+        $DIR/ledsrv -i $INSTANCE > /dev/null &
+    else
+        $interleave $DIR/ledsrv -i $INSTANCE -N > /dev/null &
+    fi
+    server=$!
+
+    while [[ ! -p $LISTENER ]]; do
+        if ! kill -0 $server 2> /dev/null; then
+            echo "$0: ledsrv exited" >&2;
+            exit 1;
+        fi
+        sleep 0.01
+    done
+
+    echo -n "$placement: "
+    $DIR/bench/throughput -p $server -i $INSTANCE "$@"
+    res=$?
+
+    kill $server
+    wait $server 2> /dev/null
+    rm -f $LISTENER
+
+    if [[ $res != 0 ]]; then
+        exit $res;
+    fi
+done
@@ -0,0 +1,47 @@
+#!/bin/bash
+
+# Time from starting ledsrv to its first response, over a number of runs.
+# Extra arguments are passed to ledsrv, e.g. -c config or -P leds.
+RUNS=${RUNS:-20}
+DIR=$(dirname $0)
+
+total=0
+min=-1
+max=0
+for ((i = 0; i < RUNS; i++)); do
+    # Fresh instance every run, so that nothing is left over from the previous one
+    INSTANCE=bench.$$.$i
+    LISTENER=/tmp/ledsrv.$INSTANCE
+
+    start=$(date +%s%N)
+    $DIR/ledsrv -i $INSTANCE "$@" > /dev/null &
+    server=$!
+
+    # Listener appears early, server may still be starting up behind it
+    while [[ ! -p $LISTENER ]]; do
+        if ! kill -0 $server 2> /dev/null; then
+            echo "$0: ledsrv exited" >&2;
+            exit 1;
+        fi
+        sleep 0.01
+    done
+
+    response=$(LEDSRV_INSTANCE=$INSTANCE $DIR/ledcli.sh get-led-state)
+    end=$(date +%s%N)
+
+    kill $server
+    wait $server 2> /dev/null
+    rm -f $LISTENER /dev/shm/ledsrv.*.$INSTANCE
+
+    if [[ $response != OK* ]]; then
+        echo "$0: unexpected response '$response'" >&2;
+        exit 1;
+    fi
+
+    usec=$(((end - start) / 1000))
+    total=$((total + usec))
+    min=$((min < 0 || usec < min ? usec : min))
+    max=$((usec > max ? usec : max))
+done
+
+echo "time to first response over $RUNS runs: avg $((total / RUNS)) us, min $min us, max $max us"
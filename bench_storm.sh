@@ -0,0 +1,30 @@
+#!/bin/bash
+
+# Connection storm: CLIENTS clients connect at once and each waits for its first response.
+# Extra arguments are passed to ledsrv, e.g. -w workers.
+CLIENTS=${CLIENTS:-200}
+DIR=$(dirname $0)
+INSTANCE=bench.$$
+LISTENER=/tmp/ledsrv.$INSTANCE
+
+# Every client holds a fifo pair open on both sides
+ulimit -n $((CLIENTS * 4 + 64)) 2> /dev/null
+
+$DIR/ledsrv -i $INSTANCE "$@" > /dev/null &
+server=$!
+
+while [[ ! -p $LISTENER ]]; do
+    if ! kill -0 $server 2> /dev/null; then
+        echo "$0: ledsrv exited" >&2;
+        exit 1;
+    fi
+    sleep 0.01
+done
+
+$DIR/bench/conn_storm -i $INSTANCE -n $CLIENTS
+res=$?
+
+kill $server
+wait $server 2> /dev/null
+rm -f $LISTENER
+exit $res
@@ -0,0 +1,38 @@
+#!/bin/bash
+
+# Request latency against CPU cost of spin-then-block waiting, one run per spin budget.
+# Server and client spin for the same budget. Extra arguments are passed to the driver, e.g. -g gap_usec.
+SPINS=${SPINS:-0 20 100 500}
+DIR=$(dirname $0)
+
+# Spinning only pays off with a spare CPU for each spinning side
+echo "$(nproc) CPUs"
+
+for spin in $SPINS; do
+    INSTANCE=bench.$$.$spin
+    LISTENER=/tmp/ledsrv.$INSTANCE
+
+    # Single worker, so that every request wakes the same wait policy
+    $DIR/ledsrv -i $INSTANCE -w 1 -s $spin > /dev/null &
+    server=$!
+
+    while [[ ! -p $LISTENER ]]; do
+        if ! kill -0 $server 2> /dev/null; then
+            echo "$0: ledsrv exited" >&2;
+            exit 1;
+        fi
+        sleep 0.01
+    done
+
+    echo -n "server spin $spin us, "
+    $DIR/bench/wait_latency -p $server -i $INSTANCE -s $spin "$@"
+    res=$?
+
+    kill $server
+    wait $server 2> /dev/null
+    rm -f $LISTENER
+
+    if [[ $res != 0 ]]; then
+        exit $res;
+    fi
+done
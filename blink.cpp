@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <boost/algorithm/string.hpp>
+
+#include "blink.h"
+
+bool ParseBlinkRate(const std::string& arg, unsigned& rate)
+{
+    const char* p = arg.c_str();
+    uint64_t value = 0;
+    unsigned digits = 0;
+
+    for (; *p >= '0' && *p <= '9'; ++p, ++digits) {
+        value = value * 10 + (*p - '0');
+        if (value > LEDSRV_RATE_MAX) {
+            return false;
+        }
+    }
+
+    if (digits == 0) {
+        return false;
+    }
+
+    // Scale to mHz, up to 3 decimals
+    unsigned decimals = 0;
+    if (*p == '.') {
+        for (++p; *p >= '0' && *p <= '9' && decimals < 3; ++p, ++decimals) {
+            value = value * 10 + (*p - '0');
+        }
+    }
+
+    if (*p != '\0') {
+        return false;
+    }
+
+    for (; decimals < 3; ++decimals) {
+        value *= 10;
+    }
+
+    if (value < LEDSRV_RATE_MIN || value > LEDSRV_RATE_MAX) {
+        return false;
+    }
+
+    rate = (unsigned)value;
+    return true;
+}
+
+std::string FormatBlinkRate(unsigned rate)
+{
+    char buf[32];
+    int len = snprintf(buf, sizeof(buf), "%u.%03u", rate / 1000, rate % 1000);
+
+    // Drop trailing zeros and a dangling point
+    while (buf[len - 1] == '0') {
+        --len;
+    }
+
+    if (buf[len - 1] == '.') {
+        --len;
+    }
+
+    return std::string(buf, len);
+}
+
+BlinkScheduler::Timing BlinkScheduler::timing(unsigned rate, unsigned duty, unsigned phase)
+{
+    Timing t;
+    t.period = 1000000000ull / rate;
+    t.on = t.period * duty / 100;
+    t.phase = t.period * phase / 360;
+    return t;
+}
+
+int BlinkScheduler::add(const std::string& text)
+{
+    std::vector<std::string> argv;
+    std::string trimmed = boost::trim_copy(text);
+    boost::split(argv, trimmed, boost::is_space(), boost::algorithm::token_compress_on);
+
+    unsigned rate;
+    if (argv.size() < 2 || argv.size() > 4 || !ParseBlinkRate(argv[1], rate)) {
+        fprintf(stderr, "Invalid blink group '%s'\n", trimmed.c_str());
+        return -1;
+    }
+
+    unsigned duty = (argv.size() > 2) ? strtoul(argv[2].c_str(), NULL, 10) : LEDSRV_DUTY_DEFAULT;
+    unsigned phase = (argv.size() > 3) ? strtoul(argv[3].c_str(), NULL, 10) : 0;
+    if (duty < 1 || duty > 99 || phase > 359) {
+        fprintf(stderr, "Invalid blink group '%s'\n", trimmed.c_str());
+        return -1;
+    }
+
+    uint16_t existing;
+    if (argv[0] == "none" || this->find(argv[0], existing) || m_groups.size() == UINT16_MAX) {
+        fprintf(stderr, "Duplicate blink group '%s'\n", argv[0].c_str());
+        return -1;
+    }
+
+    m_groups.push_back({ argv[0], timing(rate, duty, phase) });
+    return 0;
+}
+
+bool BlinkScheduler::find(const std::string& name, uint16_t& group) const
+{
+    for (size_t i = 0; i < m_groups.size(); ++i) {
+        if (m_groups[i].name == name) {
+            group = (uint16_t)(i + 1);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+const std::string& BlinkScheduler::name(uint16_t group) const
+{
+    static const std::string none = "none";
+    return (group == 0 || group > m_groups.size()) ? none : m_groups[group - 1].name;
+}
+
+bool BlinkScheduler::lit(const LedState& led, uint64_t time, uint64_t& next) const
+{
+    next = 0;
+    if (!led.state) {
+        return false;
+    }
+
+    Timing t;
+    if (led.group != 0 && led.group <= m_groups.size()) {
+        t = m_groups[led.group - 1].timing;
+        t.phase += t.period * led.phase / 360;
+    } else {
+        t = timing(led.rate, led.duty, led.phase);
+    }
+
+    // Position in current period, phase delays the period start
+    uint64_t pos = (time + t.period - t.phase % t.period) % t.period;
+    if (pos < t.on) {
+        next = t.on - pos;
+        return true;
+    }
+
+    next = t.period - pos;
+    return false;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include "ledsrv.h"
+
+/**
+ * \brief   Parse blink rate in HZ with up to 3 decimals, e.g. "2", "0.25", "12.5"
+ *
+ * \return  True if rate is valid and within [LEDSRV_RATE_MIN..LEDSRV_RATE_MAX] mHz
+ */
+extern bool ParseBlinkRate(const std::string& arg, unsigned& rate);
+
+/**
+ * \brief   Format blink rate in HZ without trailing zeros
+ */
+extern std::string FormatBlinkRate(unsigned rate);
+
+/**
+ * \brief   Blink scheduler: tells whether a blinking LED is lit at a given time.
+ *          Nothing ticks, lit state is computed on demand from time since shared epoch and LED
+ *          blink parameters in constant time, so neither LEDs nor parameters add any periodic cost.
+ *
+ *          LEDs in a blink group are phase-locked: they blink with group's rate and duty cycle,
+ *          their own phase is added to group's phase and their own rate and duty are ignored.
+ *          Groups are defined at startup:
+ *
+ *              <name> <rate> [duty] [phase]
+ */
+class BlinkScheduler : boost::noncopyable
+{
+public:
+
+    /**
+     * \brief   Parse and add a blink group.
+     *          Groups are only added at startup, before clients are served.
+     *
+     * \return  0 on success, negative value on error
+     */
+    int add(const std::string& text);
+
+    /**
+     * \brief   Find group by name
+     *
+     * \return  True if group exists, group ids start from 1
+     */
+    bool find(const std::string& name, uint16_t& group) const;
+
+    /**
+     * \brief   Group name, "none" for group 0
+     */
+    const std::string& name(uint16_t group) const;
+
+    /**
+     * \brief   Check if LED is lit
+     *
+     * \led     LED state
+     * \time    Time since blink epoch, usec
+     * \next    Time until LED toggles, usec, 0 if it never does
+     *
+     * \return  True if LED is lit at time
+     */
+    bool lit(const LedState& led, uint64_t time, uint64_t& next) const;
+
+private:
+
+    struct Timing
+    {
+        uint64_t period;    // usec
+        uint64_t on;        // Lit part of period, usec
+        uint64_t phase;     // Offset into period, usec
+    };
+
+    static Timing timing(unsigned rate, unsigned duty, unsigned phase);
+
+    struct Group
+    {
+        std::string name;
+        Timing timing;
+    };
+
+    std::vector<Group> m_groups;
+};
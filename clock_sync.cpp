@@ -0,0 +1,181 @@
+#include <errno.h>
+#include <poll.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <algorithm>
+
+#include "clock_sync.h"
+#include "wait_policy.h"
+
+// Group sockets live in abstract namespace, nothing to clean up after a crash
+static socklen_t GroupAddress(const std::string& group, struct sockaddr_un& addr)
+{
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+
+    int len = snprintf(addr.sun_path + 1, sizeof(addr.sun_path) - 1, "ledsrv.clock.%s", group.c_str());
+    return offsetof(struct sockaddr_un, sun_path) + 1 + std::min<int>(len, sizeof(addr.sun_path) - 2);
+}
+
+ClockSync::ClockSync() : m_fd(-1), m_offset(0), m_epoch(MonotonicUsec()), m_leader(true), m_stop(false)
+{
+}
+
+uint64_t ClockSync::now() const
+{
+    return MonotonicUsec() + m_offset;
+}
+
+int ClockSync::start(const std::string& group)
+{
+    m_group = group;
+
+    m_fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (m_fd < 0) {
+        perror("socket failed");
+        return -errno;
+    }
+
+    if (!this->lead()) {
+        // Follower needs an address of its own for replies, let the kernel pick one
+        sa_family_t family = AF_UNIX;
+        if (bind(m_fd, reinterpret_cast<struct sockaddr*>(&family), sizeof(family)) != 0) {
+            perror("bind failed");
+            return -errno;
+        }
+
+        m_leader = false;
+    }
+
+    m_stop = false;
+    m_thread = std::thread(&ClockSync::run, this);
+    return 0;
+}
+
+void ClockSync::stop()
+{
+    if (m_thread.joinable()) {
+        m_stop = true;
+        m_thread.join();
+    }
+
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+}
+
+// Try to take over group address
+bool ClockSync::lead()
+{
+    struct sockaddr_un addr;
+    socklen_t len = GroupAddress(m_group, addr);
+
+    int fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return false;
+    }
+
+    if (bind(fd, reinterpret_cast<struct sockaddr*>(&addr), len) != 0) {
+        ::close(fd);
+        return false;
+    }
+
+    if (m_fd >= 0) {
+        ::close(m_fd);
+    }
+
+    m_fd = fd;
+    m_leader = true;
+    return true;
+}
+
+void ClockSync::run()
+{
+    while (!m_stop) {
+        if (m_leader) {
+            this->serve();
+        } else {
+            this->follow();
+        }
+    }
+}
+
+// Answer time requests for a while
+void ClockSync::serve()
+{
+    struct pollfd pfd = { m_fd, POLLIN, 0 };
+    if (poll(&pfd, 1, kPeriodMs) <= 0) {
+        return;
+    }
+
+    Message msg;
+    struct sockaddr_un from;
+    socklen_t fromLen = sizeof(from);
+    ssize_t res = recvfrom(m_fd, &msg, sizeof(msg), MSG_DONTWAIT, reinterpret_cast<struct sockaddr*>(&from), &fromLen);
+    if (res != sizeof(msg) || msg.magic != kMagic || msg.type != kRequest) {
+        return;
+    }
+
+    msg.type = kReply;
+    msg.now = this->now();
+    msg.epoch = m_epoch;
+    sendto(m_fd, &msg, sizeof(msg), MSG_DONTWAIT, reinterpret_cast<struct sockaddr*>(&from), fromLen);
+}
+
+// Sample leader clock, take over if there's no leader
+void ClockSync::follow()
+{
+    struct sockaddr_un addr;
+    socklen_t len = GroupAddress(m_group, addr);
+
+    uint64_t bestRtt = UINT64_MAX;
+    int64_t bestOffset = 0;
+    uint64_t epoch = 0;
+
+    for (unsigned i = 0; i < kSamples && !m_stop; ++i) {
+        Message msg = {};
+        msg.magic = kMagic;
+        msg.type = kRequest;
+        msg.sent = MonotonicUsec();
+        if (sendto(m_fd, &msg, sizeof(msg), 0, reinterpret_cast<struct sockaddr*>(&addr), len) != sizeof(msg)) {
+            break; // Nobody is bound to group address
+        }
+
+        struct pollfd pfd = { m_fd, POLLIN, 0 };
+        if (poll(&pfd, 1, kPeriodMs / kSamples) <= 0) {
+            continue;
+        }
+
+        Message reply;
+        if (recv(m_fd, &reply, sizeof(reply), MSG_DONTWAIT) != sizeof(reply) || reply.magic != kMagic ||
+            reply.type != kReply || reply.sent != msg.sent) {
+            continue; // Stale reply to a request which has already timed out
+        }
+
+        // Leader read its clock about halfway through the round trip
+        uint64_t received = MonotonicUsec();
+        uint64_t rtt = received - reply.sent;
+        if (rtt < bestRtt) {
+            bestRtt = rtt;
+            bestOffset = (int64_t)(reply.now - (reply.sent + rtt / 2));
+            epoch = reply.epoch;
+        }
+    }
+
+    if (bestRtt != UINT64_MAX) {
+        m_offset = bestOffset;
+        m_epoch = epoch;
+    } else if (!m_stop && this->lead()) {
+        fprintf(stderr, "Leading clock group %s\n", m_group.c_str());
+        return;
+    }
+
+    struct pollfd none = { -1, 0, 0 };
+    poll(&none, 1, kPeriodMs);
+}
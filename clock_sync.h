@@ -0,0 +1,93 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include <boost/noncopyable.hpp>
+
+/**
+ * \brief   Time base shared by a group of server instances on one host.
+ *          Group is an abstract unix datagram socket, whichever instance binds it leads the group
+ *          and answers time requests, everyone else follows. Followers periodically sample leader's clock
+ *          and keep offset from the sample with the shortest round trip, half of which is transit time.
+ *          If leader goes away, next follower to notice takes over its socket and carries on with its
+ *          own offset and epoch, so shared time doesn't jump.
+ *
+ *          Without a group, shared time is just local monotonic time.
+ */
+class ClockSync : boost::noncopyable
+{
+public:
+
+    static const unsigned kPeriodMs = 500;      // Time between follower sync rounds
+    static const unsigned kSamples = 4;         // Requests per sync round
+
+    ClockSync();
+
+    ~ClockSync() {
+        this->stop();
+    }
+
+    /**
+     * \brief   Join clock group, lead it if there's no leader yet
+     *
+     * \return  0 on success, negative value on error
+     */
+    int start(const std::string& group);
+
+    void stop();
+
+    /**
+     * \brief   Shared time, MonotonicUsec() shifted by offset to group leader
+     */
+    uint64_t now() const;
+
+    /**
+     * \brief   Offset to add to MonotonicUsec() to get shared time
+     */
+    int64_t offset() const {
+        return m_offset;
+    }
+
+    /**
+     * \brief   Shared time origin for periodic effects such as blink phases, same for the whole group
+     */
+    uint64_t epoch() const {
+        return m_epoch;
+    }
+
+    bool is_leader() const {
+        return m_leader;
+    }
+
+private:
+
+    struct Message
+    {
+        uint32_t magic;
+        uint32_t type;          // kRequest or kReply
+        uint64_t sent;          // Follower's local time of request
+        uint64_t now;           // Leader's shared time
+        uint64_t epoch;         // Leader's epoch
+    };
+
+    static const uint32_t kMagic = 0x4c454443;  // "LEDC"
+    static const uint32_t kRequest = 1;
+    static const uint32_t kReply = 2;
+
+    void run();
+    bool lead();
+    void serve();
+    void follow();
+
+    std::string m_group;
+    int m_fd;
+    std::atomic<int64_t> m_offset;
+    std::atomic<uint64_t> m_epoch;
+    std::atomic<bool> m_leader;
+    std::atomic<bool> m_stop;
+    std::thread m_thread;
+};
@@ -0,0 +1,45 @@
+#include <stdio.h>
+
+#include <exception>
+
+#include "condition.h"
+
+int LedCondition::parse(const std::string& attribute, const std::string& value)
+{
+    m_getter = FindRequest("get-led-" + attribute, 0);
+    m_setter = FindRequest("set-led-" + attribute, 1);
+    if (!m_getter || !m_setter) {
+        fprintf(stderr, "Unknown attribute '%s'\n", attribute.c_str());
+        return -1;
+    }
+
+    m_query = { m_getter->command };
+    m_update = { m_setter->command, value };
+
+    // Run value through setter and getter to get it in the form we will be comparing against
+    try {
+        LedState scratch = {};
+        if (!this->apply(scratch) || !m_getter->handler(m_query, m_value, scratch)) {
+            throw std::invalid_argument(value);
+        }
+    } catch (const std::exception&) {
+        fprintf(stderr, "Invalid %s value '%s'\n", attribute.c_str(), value.c_str());
+        return -1;
+    }
+
+    m_update[1] = m_value;
+    return 0;
+}
+
+bool LedCondition::matches(const LedState& led) const
+{
+    LedState copy = led;
+    std::string value;
+    return m_getter->handler(m_query, value, copy) && (value == m_value);
+}
+
+bool LedCondition::apply(LedState& led) const
+{
+    std::string output;
+    return m_setter->handler(m_update, output, led);
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "ledsrv.h"
+#include "server.h"
+
+/**
+ * \brief   LED attribute condition, e.g. "color red".
+ *          Attribute is anything there is a get-led-<attribute> and set-led-<attribute> command for,
+ *          so conditions work for any attribute commands do.
+ */
+class LedCondition
+{
+public:
+
+    LedCondition() : m_getter(NULL), m_setter(NULL) {
+    }
+
+    /**
+     * \brief   Parse attribute and value.
+     *          Value is normalized to the form getter reports, so "RED" matches "red".
+     *
+     * \return  0 on success, negative value on error
+     */
+    int parse(const std::string& attribute, const std::string& value);
+
+    /**
+     * \brief   Check if LED attribute has condition value
+     */
+    bool matches(const LedState& led) const;
+
+    /**
+     * \brief   Set LED attribute to condition value
+     */
+    bool apply(LedState& led) const;
+
+    const std::string& value() const {
+        return m_value;
+    }
+
+private:
+
+    const LedRequestDesc* m_getter;
+    const LedRequestDesc* m_setter;
+    std::vector<std::string> m_query;   // Getter arguments
+    std::vector<std::string> m_update;  // Setter arguments
+    std::string m_value;
+};
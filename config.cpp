@@ -0,0 +1,74 @@
+#include <ctype.h>
+#include <stdio.h>
+
+#include <fstream>
+
+#include <boost/algorithm/string.hpp>
+
+#include "config.h"
+#include "server.h"
+
+// Parse 'alias <name> <led>'
+static bool ParseAlias(const std::vector<std::string>& argv, ServerConfig& config)
+{
+    uint32_t id;
+    if (argv.size() != 3 || isdigit(argv[1][0]) || !ParseLedId(argv[2], id)) {
+        return false;
+    }
+
+    config.aliases.emplace_back(argv[1], id);
+    return true;
+}
+
+int LoadConfig(const std::string& path, ServerConfig& config)
+{
+    std::ifstream file(path);
+    if (!file) {
+        fprintf(stderr, "Failed to open config %s\n", path.c_str());
+        return -1;
+    }
+
+    std::string line;
+    unsigned lineno = 0;
+    while (std::getline(file, line)) {
+        ++lineno;
+
+        // Strip comments
+        size_t hash = line.find('#');
+        if (hash != std::string::npos) {
+            line.erase(hash);
+        }
+
+        boost::trim(line);
+        if (line.empty()) {
+            continue;
+        }
+
+        std::vector<std::string> argv;
+        boost::split(argv, line, boost::is_space(), boost::algorithm::token_compress_on);
+
+        bool ok = false;
+        if (argv[0] == "alias") {
+            ok = ParseAlias(argv, config);
+        } else if (argv[0] == "rule" && argv.size() > 1) {
+            config.rules.push_back(line.substr(argv[0].size()));
+            ok = true;
+        } else if (argv[0] == "derive" && argv.size() > 1) {
+            config.derived.push_back(line.substr(argv[0].size()));
+            ok = true;
+        } else if (argv[0] == "macro" && argv.size() > 1) {
+            config.macros.push_back(line.substr(argv[0].size()));
+            ok = true;
+        } else if (argv[0] == "blink-group" && argv.size() > 1) {
+            config.blinkGroups.push_back(line.substr(argv[0].size()));
+            ok = true;
+        }
+
+        if (!ok) {
+            fprintf(stderr, "%s:%u: invalid directive '%s'\n", path.c_str(), lineno, line.c_str());
+            return -1;
+        }
+    }
+
+    return 0;
+}
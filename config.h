@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * \brief   Server configuration loaded at startup
+ */
+struct ServerConfig
+{
+    std::vector<std::pair<std::string, uint32_t>> aliases;  // LED names
+    std::vector<std::string> rules;                         // Rules as written after directive
+    std::vector<std::string> derived;                       // Derived LEDs as written after directive
+    std::vector<std::string> macros;                        // Macros as written after directive
+    std::vector<std::string> blinkGroups;                   // Blink groups as written after directive
+};
+
+/**
+ * \brief   Load server configuration file.
+ *          One directive per line, '#' starts a comment:
+ *
+ *          alias <name> <led>      Name an LED, name is accepted anywhere an LED address is.
+ *                                  Names must not start with a digit.
+ *
+ *          rule <led> <attribute> <value> <command> [args...]
+ *                                  Run command whenever LED attribute (state, color, rate, ...) becomes value.
+ *                                  LED names used by rules can be defined anywhere in the file.
+ *
+ *          derive <led> mirror <source>
+ *          derive <led> any|all <attribute> <value> <source> [source...]
+ *                                  Compute LED state from other LEDs, see DerivedLeds.
+ *
+ *          macro <name> <command> [args...] [; <command> [args...]]...
+ *                                  Named command sequence with $1..$9 parameters, see MacroTable.
+ *
+ *          blink-group <name> <rate> [duty] [phase]
+ *                                  Phase-locked blink group LEDs join with set-led-group, see BlinkScheduler.
+ *
+ * \return  0 on success, negative value on error
+ */
+extern int LoadConfig(const std::string& path, ServerConfig& config);
@@ -0,0 +1,166 @@
+#include <stdio.h>
+
+#include <boost/algorithm/string.hpp>
+
+#include "derived.h"
+#include "server.h"
+
+int DerivedLeds::add(const std::string& text)
+{
+    std::vector<std::string> argv;
+    std::string trimmed = boost::trim_copy(text);
+    boost::split(argv, trimmed, boost::is_space(), boost::algorithm::token_compress_on);
+
+    Node node;
+    node.matching = 0;
+
+    size_t first = 0;   // First source argument
+    if (argv.size() == 3 && argv[1] == "mirror") {
+        node.kind = kMirror;
+        first = 2;
+    } else if (argv.size() >= 5 && (argv[1] == "any" || argv[1] == "all")) {
+        node.kind = (argv[1] == "any") ? kAny : kAll;
+        if (node.condition.parse(argv[2], argv[3]) != 0) {
+            fprintf(stderr, "Invalid condition in derivation '%s'\n", trimmed.c_str());
+            return -1;
+        }
+
+        first = 4;
+    } else {
+        fprintf(stderr, "Invalid derivation '%s'\n", trimmed.c_str());
+        return -1;
+    }
+
+    if (!ResolveLed(argv[0], node.target)) {
+        fprintf(stderr, "Unknown LED '%s' in derivation '%s'\n", argv[0].c_str(), trimmed.c_str());
+        return -1;
+    }
+
+    if (m_targets.count(node.target)) {
+        fprintf(stderr, "LED '%s' is derived more than once\n", argv[0].c_str());
+        return -1;
+    }
+
+    for (size_t i = first; i < argv.size(); ++i) {
+        uint32_t id;
+        if (!ResolveLed(argv[i], id)) {
+            fprintf(stderr, "Unknown LED '%s' in derivation '%s'\n", argv[i].c_str(), trimmed.c_str());
+            return -1;
+        }
+
+        node.sources.push_back(id);
+    }
+
+    size_t index = m_nodes.size();
+    m_nodes.push_back(node);
+    m_targets[node.target] = index;
+    for (uint32_t source : node.sources) {
+        m_deps[source].push_back(index);
+    }
+
+    return 0;
+}
+
+// Depth-first search for a back edge
+bool DerivedLeds::has_cycle() const
+{
+    enum Color { kWhite = 0, kGray, kBlack };
+    std::vector<Color> color(m_nodes.size(), kWhite);
+    std::vector<std::pair<size_t, size_t>> stack; // Node and next dependent to visit
+
+    for (size_t root = 0; root < m_nodes.size(); ++root) {
+        if (color[root] != kWhite) {
+            continue;
+        }
+
+        color[root] = kGray;
+        stack.emplace_back(root, 0);
+        while (!stack.empty()) {
+            size_t node = stack.back().first;
+            size_t& next = stack.back().second;
+
+            auto deps = m_deps.find(m_nodes[node].target);
+            if (deps == m_deps.end() || next >= deps->second.size()) {
+                color[node] = kBlack;
+                stack.pop_back();
+                continue;
+            }
+
+            size_t dep = deps->second[next++];
+            if (color[dep] == kGray) {
+                fprintf(stderr, "Derived LED %u depends on itself\n", m_nodes[dep].target);
+                return true;
+            }
+
+            if (color[dep] == kWhite) {
+                color[dep] = kGray;
+                stack.emplace_back(dep, 0);
+            }
+        }
+    }
+
+    return false;
+}
+
+int DerivedLeds::start()
+{
+    if (this->has_cycle()) {
+        return -1;
+    }
+
+    // Count matching sources first, so that changes made while settling targets are counted as deltas
+    for (Node& node : m_nodes) {
+        node.matching = 0;
+        if (node.kind != kMirror) {
+            for (uint32_t source : node.sources) {
+                node.matching += node.condition.matches(GetLedState(source));
+            }
+        }
+    }
+
+    for (const Node& node : m_nodes) {
+        this->update(node);
+    }
+
+    return 0;
+}
+
+void DerivedLeds::update(const Node& node)
+{
+    LedState led = GetLedState(node.target);
+
+    if (node.kind == kMirror) {
+        led = GetLedState(node.sources[0]);
+    } else {
+        bool on = (node.kind == kAny) ? (node.matching > 0) : (node.matching == node.sources.size());
+        led.state = on;
+        if (on) {
+            node.condition.apply(led);
+        }
+    }
+
+    CommitLedState(node.target, led);
+}
+
+void DerivedLeds::on_change(uint32_t id, const LedState& old, const LedState& now)
+{
+    auto deps = m_deps.find(id);
+    if (deps == m_deps.end()) {
+        return;
+    }
+
+    for (size_t index : deps->second) {
+        Node& node = m_nodes[index];
+        if (node.kind != kMirror) {
+            bool was = node.condition.matches(old);
+            bool is = node.condition.matches(now);
+            if (was == is) {
+                continue;
+            }
+
+            is ? ++node.matching : --node.matching;
+        }
+
+        this->update(node);
+    }
+}
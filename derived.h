@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include "condition.h"
+#include "ledsrv.h"
+
+/**
+ * \brief   LEDs whose state is computed from other LEDs:
+ *
+ *              <target> mirror <led>                               Target copies LED state
+ *              <target> any <attribute> <value> <led> [led...]     Target is on with attribute set to value
+ *              <target> all <attribute> <value> <led> [led...]     when any/all of LEDs have it, off otherwise
+ *
+ *          Derivations form a dependency graph indexed by source LED. A change only recomputes derivations
+ *          depending on the changed LED, any/all keep a count of matching sources which is adjusted by the
+ *          change instead of rescanning all sources. Derived LEDs may feed other derivations, cycles are rejected.
+ */
+class DerivedLeds : boost::noncopyable
+{
+public:
+
+    /**
+     * \brief   Parse and add a derivation.
+     *          Derivations are only added at startup, before clients are served.
+     *
+     * \return  0 on success, negative value on error
+     */
+    int add(const std::string& text);
+
+    /**
+     * \brief   Check dependency graph and compute initial state of derived LEDs.
+     *          Caller must hold state lock.
+     *
+     * \return  0 on success, negative value on error
+     */
+    int start();
+
+    /**
+     * \brief   Recompute derivations depending on changed LED.
+     *          Caller must hold state lock.
+     */
+    void on_change(uint32_t id, const LedState& old, const LedState& now);
+
+private:
+
+    enum Kind {
+        kMirror = 0,
+        kAny,
+        kAll,
+    };
+
+    struct Node
+    {
+        uint32_t target;
+        Kind kind;
+        LedCondition condition;
+        std::vector<uint32_t> sources;
+        size_t matching;            // Number of sources matching condition
+    };
+
+    void update(const Node& node);
+    bool has_cycle() const;
+
+    std::vector<Node> m_nodes;
+    std::unordered_map<uint32_t, std::vector<size_t>> m_deps;  // Source LED to dependent nodes
+    std::unordered_map<uint32_t, size_t> m_targets;            // Target LED to its node
+};
@@ -0,0 +1,408 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <limits.h>
+#include <assert.h>
+
+#include "ledsrv.h"
+#include "fifo.h"
+
+int Fifo::create(const std::string& name, Fifo::Type type)
+{
+    // Opening the same fifo?
+    if (m_name && (name == *m_name)) {
+        return 0;
+    }
+
+    int res = 0;
+    res = ::access(name.c_str(), F_OK);
+    if (res == 0) {
+        // File exists, check if it's a pipe and remove it
+        struct stat st;
+        res = ::stat(name.c_str(), &st);
+        if (res != 0) {
+            perror("stat failed");
+            return res;
+        }
+
+        if (S_IFIFO & st.st_mode) {
+            res = ::unlink(name.c_str());
+            if (res != 0) {
+                perror("unlink failed");
+                return res;
+            }
+        }
+    }
+
+    res = ::mkfifo(name.c_str(), S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (res != 0) {
+        perror("mkfifo failed");
+        return res;
+    }
+
+    res = this->open(name, type, kFifoDeleteOnClose);
+    if (res != 0) {
+        ::unlink(name.c_str());
+    }
+
+    return 0;
+}
+
+int Fifo::open(const std::string& name, Type type, int flags /* = kDefault */)
+{
+    static const int modes[] = { O_RDONLY, O_WRONLY, O_RDWR };
+
+    int fd = ::open(name.c_str(), modes[type] | ((flags & kFifoNonBlock) ? O_NONBLOCK : 0));
+    if (fd < 0) {
+        return fd;
+    }
+
+    this->close();
+
+    m_fd = fd;
+    if (flags & kFifoDeleteOnClose) {
+        m_name.reset(new std::string(name));
+    }
+
+    return 0;
+}
+
+int Fifo::adopt(int fd)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+
+    int rw = ::open(path, O_RDWR | O_CLOEXEC);
+    if (rw < 0) {
+        perror("open failed");
+        return -errno;
+    }
+
+    ::close(fd);
+    this->close();
+
+    m_fd = rw;
+    return 0;
+}
+
+void Fifo::close()
+{
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        if (m_name) {
+            ::unlink(m_name->c_str());
+            m_name.reset();
+        }
+
+        m_fd = -1;
+    }
+}
+
+ssize_t Fifo::read(void* data, size_t bytes)
+{
+    assert(data);
+    return ::read(m_fd, data, bytes);
+}
+
+ssize_t Fifo::write(const void* data, size_t bytes)
+{
+    assert(data);
+    return ::write(m_fd, data, bytes);
+}
+
+ssize_t Fifo::splice(const void* data, size_t bytes)
+{
+    struct iovec iov = { const_cast<void*>(data), bytes };
+    ssize_t res;
+    do {
+        res = ::vmsplice(m_fd, &iov, 1, SPLICE_F_NONBLOCK);
+        if (res < 0 && errno == EINVAL) {
+            res = ::write(m_fd, data, bytes); // Not a pipe
+        }
+    } while (res < 0 && errno == EINTR);
+
+    return res;
+}
+
+bool ClientId::parse(const std::string& req)
+{
+    const char* p = req.c_str();
+    char* end;
+
+    errno = 0;
+    long val = strtol(p, &end, 10);
+    if (end == p || val <= 0 || val > INT_MAX || errno != 0) {
+        return false;
+    }
+
+    pid = (pid_t)val;
+    index = 0;
+
+    if (*end == '.') {
+        p = end + 1;
+        unsigned long idx = strtoul(p, &end, 10);
+        if (end == p || idx == 0 || idx > UINT32_MAX || errno != 0) {
+            return false;
+        }
+
+        index = (uint32_t)idx;
+    }
+
+    return *end == '\0';
+}
+
+std::string ClientId::fifo(const char* format) const
+{
+    char buf[PATH_MAX] = {0};
+
+    int len = snprintf(buf, sizeof(buf), format, pid);
+    if (index != 0) {
+        snprintf(buf + len, sizeof(buf) - len, LEDSRV_CONN_INDEX, index);
+    }
+
+    return std::string(buf);
+}
+
+int Connection::open(const ClientId& id)
+{
+    int err = m_in.open(id.fifo(LEDSRV_IN_FIFO), Fifo::kFifoRead, Fifo::kFifoNonBlock);
+    if (err < 0) {
+        return err;
+    }
+
+    m_id = id;
+    return 0;
+}
+
+void Connection::close()
+{
+    m_in.close();
+    m_out.close();
+    m_partial.reset();
+    m_backlog.reset();
+    m_failed = false;
+    m_protocol = kProtocolText;
+    m_id.pid = 0;
+    m_id.index = 0;
+}
+
+bool Connection::read_requests(std::vector<std::string>& req)
+{
+    bool open = true;
+
+    req.clear();
+
+    // Pick up leftovers from previous read
+    std::string input;
+    if (m_partial) {
+        input.swap(*m_partial);
+        m_partial.reset();
+    }
+
+    // Drain the fifo
+    char buf[PIPE_BUF];
+    for (;;) {
+        ssize_t res = m_in.read(buf, sizeof(buf));
+        if (res > 0) {
+            input.append(buf, res);
+        } else if (res == 0) {
+            open = false; // All writers are gone
+            break;
+        } else if (errno != EINTR) {
+            open = (errno == EAGAIN);
+            break;
+        }
+    }
+
+    // Cut complete lines, skipping empty ones
+    size_t pos = 0;
+    size_t end;
+    while ((end = input.find('\n', pos)) != std::string::npos) {
+        if (end > pos) {
+            req.emplace_back(input, pos, end - pos);
+        }
+
+        pos = end + 1;
+    }
+
+    if (pos < input.size()) {
+        if (open && input.size() - pos > kMaxLine) {
+            // Client is never going to finish this line, don't hold on to whatever it keeps sending
+            this->fail(-E2BIG);
+            open = false;
+        } else if (open) {
+            m_partial.reset(new std::string(input, pos));
+        } else {
+            // Client is gone, take unterminated tail as is
+            req.emplace_back(input, pos);
+        }
+    }
+
+    return open;
+}
+
+int Connection::open_output()
+{
+    if (m_out.is_open()) {
+        return 0;
+    }
+
+    // ENXIO means client hasn't opened its end yet, output waits in backlog until it does
+    int err = m_out.open(m_id.fifo(LEDSRV_OUT_FIFO), Fifo::kFifoWrite, Fifo::kFifoNonBlock);
+    if (err < 0) {
+        return (errno == ENXIO) ? -ENXIO : this->fail(-errno);
+    }
+
+    return 0;
+}
+
+// Nothing more gets through to client, it only waits to be closed now
+int Connection::fail(int err)
+{
+    m_failed = true;
+    m_backlog.reset();
+    return err;
+}
+
+int Connection::write(const void* data, size_t bytes)
+{
+    if (m_failed) {
+        return -EPIPE;
+    }
+
+    // Output can only go straight out when nothing is queued ahead of it
+    const char* p = static_cast<const char*>(data);
+    if (!m_backlog) {
+        int err = this->open_output();
+        if (err == 0) {
+            ssize_t res;
+            do {
+                res = m_out.write(p, bytes);
+            } while (res < 0 && errno == EINTR);
+
+            if (res < 0 && errno != EAGAIN) {
+                return this->fail(-errno);
+            }
+
+            if (res > 0) {
+                p += res;
+                bytes -= res;
+            }
+
+            if (bytes == 0) {
+                return 0;
+            }
+        } else if (err != -ENXIO) {
+            return err;
+        }
+
+        m_backlog.reset(new Backlog());
+    }
+
+    if (m_backlog->text + bytes > kMaxBacklog) {
+        return this->fail(-ENOBUFS);
+    }
+
+    // Consecutive writes share a single piece of text
+    std::deque<Output>& queue = m_backlog->queue;
+    if (queue.empty() || queue.back().pages) {
+        queue.push_back(Output{ std::string(), nullptr, 0 });
+    }
+
+    queue.back().text.append(p, bytes);
+    m_backlog->text += bytes;
+    return 0;
+}
+
+int Connection::splice(std::unique_ptr<PageBuffer> pages)
+{
+    if (m_failed) {
+        return -EPIPE;
+    }
+
+    size_t offset = 0;
+    if (!m_backlog) {
+        int err = this->open_output();
+        if (err == 0) {
+            while (offset < pages->size()) {
+                ssize_t res = m_out.splice(pages->data() + offset, pages->size() - offset);
+                if (res < 0) {
+                    if (errno != EAGAIN) {
+                        return this->fail(-errno);
+                    }
+
+                    break;
+                }
+
+                offset += res;
+            }
+
+            if (offset == pages->size()) {
+                return 0;
+            }
+        } else if (err != -ENXIO) {
+            return err;
+        }
+
+        m_backlog.reset(new Backlog());
+    }
+
+    size_t bytes = pages->size() - offset;
+    if (m_backlog->pages + bytes > kMaxBacklogPages) {
+        return this->fail(-ENOBUFS);
+    }
+
+    m_backlog->queue.push_back(Output{ std::string(), std::move(pages), offset });
+    m_backlog->pages += bytes;
+    return 0;
+}
+
+int Connection::flush()
+{
+    if (m_failed) {
+        return -EPIPE;
+    }
+
+    int err = this->open_output();
+    if (err < 0) {
+        return (err == -ENXIO) ? 0 : err;
+    }
+
+    while (m_backlog) {
+        Output& out = m_backlog->queue.front();
+        const char* data = out.pages ? out.pages->data() : out.text.data();
+        size_t size = out.pages ? out.pages->size() : out.text.size();
+
+        ssize_t res;
+        if (out.pages) {
+            res = m_out.splice(data + out.offset, size - out.offset);
+        } else {
+            do {
+                res = m_out.write(data + out.offset, size - out.offset);
+            } while (res < 0 && errno == EINTR);
+        }
+
+        if (res < 0) {
+            return (errno == EAGAIN) ? 0 : this->fail(-errno);
+        }
+
+        // Counters hold what is left to write, pages spliced before they were queued were never counted
+        (out.pages ? m_backlog->pages : m_backlog->text) -= res;
+        out.offset += res;
+        if (out.offset < size) {
+            continue;
+        }
+
+        m_backlog->queue.pop_front();
+        if (m_backlog->queue.empty()) {
+            m_backlog.reset();
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,270 @@
+#pragma once
+
+#include <limits.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include "page_buffer.h"
+
+/**
+ * \brief   RAII helper for pipe descriptor
+ */
+class Fifo : boost::noncopyable
+{
+public:
+
+    enum Type {
+        kFifoRead = 0,
+        kFifoWrite,
+        kFifoReadWrite, // Both ends: read end never sees EOF when clients go away, write end never waits for a reader
+    };
+
+    enum Flags {
+        kFifoDefault = 0,
+        kFifoDeleteOnClose = 1 << 0,    // Delete fifo on close
+        kFifoNonBlock = 1 << 1,         // Open in non-blocking mode
+    };
+
+    Fifo() : m_fd(-1) {
+    }
+
+    ~Fifo() {
+        this->close();
+    }
+
+    /**
+     * \brief   Create a fifo with name and type
+     *          Will block until remote end is opened for appropriate access.
+     *
+     * \return  0 on success, negative value on error
+     */
+    int create(const std::string& name, Type type);
+
+    /**
+     * \brief   Open existing fifo
+     *
+     * \return  0 on success, negative value on error
+     */
+    int open(const std::string& name, Type type, int flags = kFifoDefault);
+
+    /**
+     * \brief   Take over read end of a fifo inherited from parent process.
+     *          Fifo is reopened for reading and writing, so it never sees EOF and doesn't share
+     *          file status flags with parent. Fifo is never deleted on close, it belongs to whoever created it.
+     *
+     * \return  0 on success, negative value on error
+     */
+    int adopt(int fd);
+
+    /**
+     * \brief   Read data from a fifo
+     */
+    ssize_t read(void* data, size_t bytes);
+
+    /**
+     * \brief   Write data to a fifo
+     */
+    ssize_t write(const void* data, size_t bytes);
+
+    /**
+     * \brief   Hand pages over to a fifo without copying them, falls back to write() if fifo can't take pages.
+     *          Pages must not change afterwards, see PageBuffer. Never blocks, takes only what fits into fifo.
+     *
+     * \return  Number of bytes handed over, negative value on error with errno set
+     */
+    ssize_t splice(const void* data, size_t bytes);
+
+    /**
+     * \brief   Close fifo.
+     */
+    void close();
+
+    bool is_open() const {
+        return m_fd >= 0;
+    }
+
+    int fd() const {
+        return m_fd;
+    }
+
+private:
+
+    int m_fd;
+    std::unique_ptr<std::string> m_name; // Only kept for fifos we delete on close
+};
+
+/**
+ * \brief   Client connection id, client fifo names are derived from it.
+ *          Connection request is "<pid>" for a process with a single connection
+ *          and "<pid>.<index>" for additional connections, index is never 0.
+ */
+struct ClientId
+{
+    pid_t pid;
+    uint32_t index;
+
+    /**
+     * \brief   Parse connection request
+     *
+     * \return  True if request is a valid client id
+     */
+    bool parse(const std::string& req);
+
+    /**
+     * \brief   Format fifo name from LEDSRV_IN_FIFO/LEDSRV_OUT_FIFO template
+     */
+    std::string fifo(const char* format) const;
+};
+
+/**
+ * \brief   RAII helper to hold client connection fifos
+ *          Both fifos are non-blocking so that connection can be multiplexed by an event loop.
+ *          Output fifo is opened on first write, output to a client which hasn't opened its end yet
+ *          waits in backlog until it does.
+ *
+ *          Output client doesn't read right away is kept in a backlog and written by flush() when client
+ *          catches up. Client which lets backlog grow over the limit, or can't be written to at all,
+ *          fails the connection: all further writes fail and the connection should be closed.
+ *
+ *          Most clients sit idle between requests, so connection is kept down to a small fixed header:
+ *          input buffer is only allocated while an incomplete request is pending, and backlog only
+ *          while there is output waiting for client.
+ */
+class Connection : boost::noncopyable
+{
+public:
+
+    static const size_t kMaxBacklog = 1024 * 1024;          // Responses and events client may leave unread
+    static const size_t kMaxBacklogPages = 64 * 1024 * 1024;// Bulk response pages client may leave unread
+    static const size_t kMaxLine = 4 * PIPE_BUF;            // Longest request line
+
+    enum Protocol {
+        kProtocolText = 0,  // Plain text request lines
+        kProtocolJson,      // JSON object per line, see JsonRequest
+    };
+
+    Connection() : m_protocol(kProtocolText), m_failed(false) {
+        m_id.pid = 0;
+        m_id.index = 0;
+    }
+
+    ~Connection() {
+        this->close();
+    }
+
+    /**
+     * \brief   Init connection to specified client
+     *
+     * \return  0 on success, negative value on error
+     */
+    int open(const ClientId& id);
+
+    /**
+     * \brief   Close connection
+     */
+    void close();
+
+    /**
+     * \brief   Read pending '\n'-separated requests
+     *          Partial lines are kept until the rest of them arrive, one growing past kMaxLine fails the connection.
+     *
+     * \return  False if remote end has closed the connection, on error or when connection has failed
+     */
+    bool read_requests(std::vector<std::string>& req);
+
+    /**
+     * \brief   Write data to client, opening output fifo if needed.
+     *          Never blocks, whatever doesn't fit into output fifo goes to backlog.
+     *
+     * \return  0 on success, negative value if connection has failed
+     */
+    int write(const void* data, size_t bytes);
+
+    /**
+     * \brief   Zero-copy write of sealed pages to client, see Fifo::splice.
+     *          Pages which don't fit into output fifo go to backlog, so connection takes them over.
+     *
+     * \return  0 on success, negative value if connection has failed
+     */
+    int splice(std::unique_ptr<PageBuffer> pages);
+
+    /**
+     * \brief   Write out as much of backlog as client has room for, opening output fifo if needed
+     *
+     * \return  0 on success, negative value if connection has failed
+     */
+    int flush();
+
+    /**
+     * \brief   True while there is output waiting for client to read some
+     */
+    bool backlogged() const {
+        return m_backlog != nullptr;
+    }
+
+    bool failed() const {
+        return m_failed;
+    }
+
+    Fifo& in() {
+        return m_in;
+    }
+
+    Fifo& out() {
+        return m_out;
+    }
+
+    const ClientId& id() const {
+        return m_id;
+    }
+
+    /**
+     * \brief   Protocol spoken on this connection.
+     *          Only changed by worker owning the connection, which also formats change events for it.
+     */
+    Protocol protocol() const {
+        return m_protocol;
+    }
+
+    void set_protocol(Protocol protocol) {
+        m_protocol = protocol;
+    }
+
+private:
+
+    // Piece of output client hasn't read yet, either copied text or pages handed over by splice()
+    struct Output
+    {
+        std::string text;
+        std::unique_ptr<PageBuffer> pages;
+        size_t offset;                  // Bytes already written
+    };
+
+    struct Backlog
+    {
+        Backlog() : text(0), pages(0) {
+        }
+
+        std::deque<Output> queue;
+        size_t text;                    // Text bytes left to write
+        size_t pages;                   // Page bytes left to write
+    };
+
+    int open_output();
+    int fail(int err);
+
+    ClientId m_id;
+    Protocol m_protocol;
+    bool m_failed;
+    Fifo m_in;
+    Fifo m_out;
+    std::unique_ptr<std::string> m_partial; // Incomplete trailing request, if any
+    std::unique_ptr<Backlog> m_backlog;     // Output waiting for client, if any
+};
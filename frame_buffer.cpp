@@ -0,0 +1,217 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+
+#include <algorithm>
+
+#include "frame_buffer.h"
+#include "wait_policy.h"
+
+// Control block and slots each start on their own cache line
+static const size_t kLineSize = 64;
+
+static size_t RoundUp(size_t size)
+{
+    return (size + kLineSize - 1) & ~(kLineSize - 1);
+}
+
+static size_t SlotSize(uint32_t capacity)
+{
+    return RoundUp(sizeof(LedFrameSlot) + (size_t)capacity * sizeof(LedFrameEntry));
+}
+
+size_t LedFrameBuffer::size(uint32_t capacity)
+{
+    return RoundUp(sizeof(LedFrameControl)) + LedFrameControl::kSlots * SlotSize(capacity);
+}
+
+LedFrameSlot* LedFrameBuffer::slot(uint32_t index)
+{
+    if (index >= LedFrameControl::kSlots) {
+        return NULL;
+    }
+
+    char* base = reinterpret_cast<char*>(m_control) + RoundUp(sizeof(LedFrameControl));
+    return reinterpret_cast<LedFrameSlot*>(base + index * SlotSize(m_capacity));
+}
+
+int LedFrameBuffer::map(int fd, size_t size)
+{
+    void* mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mem == MAP_FAILED) {
+        perror("mmap failed");
+        return -errno;
+    }
+
+    m_control = static_cast<LedFrameControl*>(mem);
+    m_size = size;
+    return 0;
+}
+
+int LedFrameBuffer::create(const char* name, uint32_t capacity)
+{
+    // Whatever is left over from previous run may have another layout
+    shm_unlink(name);
+
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+    if (fd < 0) {
+        perror("shm_open failed");
+        return -errno;
+    }
+
+    size_t bytes = LedFrameBuffer::size(capacity);
+    int err = 0;
+    if (ftruncate(fd, bytes) != 0) {
+        perror("ftruncate failed");
+        err = -errno;
+    } else {
+        err = this->map(fd, bytes);
+    }
+
+    ::close(fd);
+    if (err != 0) {
+        shm_unlink(name);
+        return err;
+    }
+
+    // Server starts with slot 0, producer with slot 2, slot 1 is in the middle and holds nothing yet
+    m_capacity = capacity;
+    m_control->capacity = capacity;
+    m_control->middle = 1;
+    m_control->back = 2;
+    m_control->futex = 0;
+    m_control->waiting = 0;
+    m_control->clock = 0;
+    for (uint32_t i = 0; i < LedFrameControl::kSlots; ++i) {
+        this->slot(i)->count = 0;
+    }
+
+    std::atomic_thread_fence(std::memory_order_release);
+    m_control->magic = LedFrameControl::kMagic;
+    return 0;
+}
+
+int LedFrameBuffer::open(const char* name)
+{
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0) {
+        return -errno;
+    }
+
+    int err = 0;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        err = -errno;
+    } else if ((size_t)st.st_size < sizeof(LedFrameControl)) {
+        err = -EINVAL;
+    } else {
+        err = this->map(fd, st.st_size);
+    }
+
+    ::close(fd);
+    if (err != 0) {
+        return err;
+    }
+
+    m_capacity = m_control->capacity;
+    if (m_control->magic != LedFrameControl::kMagic || LedFrameBuffer::size(m_capacity) > m_size) {
+        this->close();
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
+void LedFrameBuffer::close()
+{
+    if (m_control) {
+        munmap(m_control, m_size);
+        m_control = NULL;
+        m_size = 0;
+        m_capacity = 0;
+    }
+}
+
+void LedFrameBuffer::wake()
+{
+    m_control->futex.fetch_add(1);
+    if (m_control->waiting.load()) {
+        syscall(SYS_futex, &m_control->futex, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+    }
+}
+
+void LedFrameBuffer::wait(uint32_t seen, int64_t timeoutUsec /* = -1 */)
+{
+    struct timespec ts;
+    ts.tv_sec = timeoutUsec / 1000000;
+    ts.tv_nsec = (timeoutUsec % 1000000) * 1000;
+
+    // Publisher checks waiting flag after bumping futex word, so either it sees the flag
+    // or we see the new futex value and don't sleep
+    m_control->waiting.store(1);
+    if (m_control->futex.load() == seen) {
+        syscall(SYS_futex, &m_control->futex, FUTEX_WAIT, seen, (timeoutUsec >= 0) ? &ts : NULL, NULL, 0);
+    }
+
+    m_control->waiting.store(0);
+}
+
+int LedFrameProducer::open(const char* name /* = LEDSRV_FRAME_SHM */)
+{
+    int err = m_buffer.open(name);
+    if (err != 0) {
+        return err;
+    }
+
+    m_slot = m_buffer.slot(m_buffer.control()->back.load() & LedFrameControl::kSlotMask);
+    if (!m_slot) {
+        m_buffer.close();
+        return -EINVAL;
+    }
+
+    // Carry on numbering where previous producer stopped
+    m_sequence = 0;
+    for (uint32_t i = 0; i < LedFrameControl::kSlots; ++i) {
+        m_sequence = std::max(m_sequence, m_buffer.slot(i)->sequence);
+    }
+
+    return 0;
+}
+
+uint64_t LedFrameProducer::now()
+{
+    return MonotonicUsec() + m_buffer.control()->clock.load(std::memory_order_relaxed);
+}
+
+LedFrameEntry* LedFrameProducer::frame(uint32_t base, uint32_t count)
+{
+    if (count > m_buffer.capacity()) {
+        return NULL;
+    }
+
+    m_slot->base = base;
+    m_slot->count = count;
+    return m_slot->entries();
+}
+
+void LedFrameProducer::publish(uint64_t presentUsec /* = 0 */)
+{
+    LedFrameControl* control = m_buffer.control();
+
+    m_slot->sequence = ++m_sequence;
+    m_slot->present = presentUsec;
+
+    uint32_t back = control->back.load();
+    back = control->middle.exchange(back | LedFrameControl::kFresh) & LedFrameControl::kSlotMask;
+    control->back.store(back);
+    m_slot = m_buffer.slot(back);
+
+    m_buffer.wake();
+}
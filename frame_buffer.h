@@ -0,0 +1,192 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+
+#include <boost/noncopyable.hpp>
+
+#include "ledsrv.h"
+
+/**
+ * \brief   LED state as stored in shared memory frames
+ */
+struct LedFrameEntry
+{
+    uint8_t state;      // 0 or 1
+    uint8_t color;      // LedColor value
+    uint8_t rate;       // Blink rate in HZ [1..60]
+    uint8_t reserved;
+};
+
+/**
+ * \brief   Shared memory frame triple buffer.
+ *          Producer fills its back slot and swaps it with the middle slot, server swaps its front slot
+ *          with the middle one whenever middle holds a fresh frame. Neither side ever waits for the other
+ *          and server always sees the newest complete frame, skipped frames are simply overwritten.
+ *
+ *          Every publish bumps the futex word, server sleeps on it when there's nothing fresh.
+ *          Presentation times are in server time base, which server keeps in the clock offset.
+ *          There may be a single producer at a time.
+ */
+struct LedFrameControl
+{
+    static const uint32_t kMagic = 0x4c454446;  // "LEDF"
+    static const uint32_t kFresh = 1u << 31;    // Set in middle when it holds an unconsumed frame
+    static const uint32_t kSlotMask = 3;
+    static const uint32_t kSlots = 3;           // Slot indices above are invalid even though they fit the mask
+
+    uint32_t magic;
+    uint32_t capacity;              // LED entries per slot
+    std::atomic<uint32_t> middle;   // Middle slot index, kFresh if it was published and not consumed yet
+    std::atomic<uint32_t> back;     // Producer's slot index, kept here so that a restarted producer can pick up
+    std::atomic<uint32_t> futex;    // Bumped on every publish
+    std::atomic<uint32_t> waiting;  // Server is asleep on futex
+    std::atomic<int64_t> clock;     // Offset from MonotonicUsec() to server time base
+};
+
+/**
+ * \brief   Frame slot header, followed by capacity entries
+ */
+struct LedFrameSlot
+{
+    uint64_t sequence;  // Producer's frame number
+    uint64_t present;   // Presentation time, MonotonicUsec() clock, 0 to present right away
+    uint32_t base;      // First LED address in frame
+    uint32_t count;     // Number of valid entries
+
+    LedFrameEntry* entries() {
+        return reinterpret_cast<LedFrameEntry*>(this + 1);
+    }
+};
+
+/**
+ * \brief   Mapping of frame shared memory, common part of producer and server sides
+ */
+class LedFrameBuffer : boost::noncopyable
+{
+public:
+
+    LedFrameBuffer() : m_control(NULL), m_size(0), m_capacity(0) {
+    }
+
+    ~LedFrameBuffer() {
+        this->close();
+    }
+
+    /**
+     * \brief   Create shared memory for frames of up to capacity LEDs, replacing any stale one.
+     *          Server side.
+     *
+     * \return  0 on success, negative value on error
+     */
+    int create(const char* name, uint32_t capacity);
+
+    /**
+     * \brief   Map existing shared memory. Producer side.
+     *
+     * \return  0 on success, negative value on error
+     */
+    int open(const char* name);
+
+    void close();
+
+    bool is_open() const {
+        return m_control != NULL;
+    }
+
+    /**
+     * \brief   LED entries per slot, as of create() or open().
+     *          Shared copy can be overwritten by the other side, this one can't.
+     */
+    uint32_t capacity() const {
+        return m_capacity;
+    }
+
+    LedFrameControl* control() {
+        return m_control;
+    }
+
+    /**
+     * \brief   Slot by index
+     *
+     * \return  NULL if there is no such slot
+     */
+    LedFrameSlot* slot(uint32_t index);
+
+    /**
+     * \brief   Wake server sleeping in wait(), if any
+     */
+    void wake();
+
+    /**
+     * \brief   Sleep until futex word moves away from seen value or timeout expires
+     *
+     * \timeoutUsec Timeout in microseconds, negative value to wait forever
+     */
+    void wait(uint32_t seen, int64_t timeoutUsec = -1);
+
+    /**
+     * \brief   Size of shared memory for frames of capacity LEDs
+     */
+    static size_t size(uint32_t capacity);
+
+private:
+
+    int map(int fd, size_t size);
+
+    LedFrameControl* m_control;
+    size_t m_size;
+    uint32_t m_capacity;
+};
+
+/**
+ * \brief   Frame producer.
+ *          Typical loop fills frame() and calls publish() once per frame, no system calls are made
+ *          unless server is asleep.
+ */
+class LedFrameProducer : boost::noncopyable
+{
+public:
+
+    LedFrameProducer() : m_slot(NULL), m_sequence(0) {
+    }
+
+    /**
+     * \brief   Attach to server frame input
+     *
+     * \return  0 on success, negative value on error
+     */
+    int open(const char* name = LEDSRV_FRAME_SHM);
+
+    uint32_t capacity() const {
+        return m_buffer.capacity();
+    }
+
+    /**
+     * \brief   Current time in server time base, presentation times are relative to it
+     */
+    uint64_t now();
+
+    /**
+     * \brief   Get frame to fill, covering LEDs base..base+count-1.
+     *          Frame is not cleared, it holds whatever was written into this slot before.
+     *
+     * \return  Frame entries, NULL if count exceeds capacity
+     */
+    LedFrameEntry* frame(uint32_t base, uint32_t count);
+
+    /**
+     * \brief   Hand filled frame over to server
+     *
+     * \presentUsec When server should present the frame, see now().
+     *              0 presents it as soon as server picks it up.
+     */
+    void publish(uint64_t presentUsec = 0);
+
+private:
+
+    LedFrameBuffer m_buffer;
+    LedFrameSlot* m_slot;       // Back slot
+    uint64_t m_sequence;
+};
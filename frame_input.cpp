@@ -0,0 +1,241 @@
+#include <errno.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+
+#include <algorithm>
+
+#include "clock_sync.h"
+#include "frame_input.h"
+#include "server.h"
+#include "task_pool.h"
+
+int FrameInput::create(const char* name, uint32_t capacity)
+{
+    int err = m_buffer.create(name, capacity);
+    if (err != 0) {
+        return err;
+    }
+
+    // Jitter buffer is allocated up front, frames are never allocated on the way in
+    m_frames.clear();
+    m_free.clear();
+    for (size_t i = 0; i < kJitterDepth; ++i) {
+        m_frames.emplace_back(new Frame());
+        m_frames.back()->entries.resize(capacity);
+        m_free.push_back(m_frames.back().get());
+    }
+
+    m_queue.reserve(kJitterDepth);
+    m_changed.resize(capacity);
+
+    m_name = name;
+    m_front = 0;
+    m_sequence = 0;
+    return 0;
+}
+
+int FrameInput::start(const ClockSync& clock, TaskPool& tasks)
+{
+    if (!m_buffer.is_open()) {
+        return -EINVAL;
+    }
+
+    m_clock = &clock;
+    m_tasks = &tasks;
+    m_stop = false;
+    m_thread = std::thread(&FrameInput::run, this);
+    return 0;
+}
+
+void FrameInput::stop()
+{
+    if (m_thread.joinable()) {
+        m_stop = true;
+        m_buffer.wake();
+        m_thread.join();
+    }
+
+    if (m_buffer.is_open()) {
+        m_buffer.close();
+        shm_unlink(m_name);
+    }
+}
+
+FrameInput::Stats FrameInput::stats() const
+{
+    Stats stats;
+    stats.presented = m_presented;
+    stats.late = m_late;
+    stats.dropped = m_dropped;
+    stats.skipped = m_skipped;
+    return stats;
+}
+
+void FrameInput::run()
+{
+    LedFrameControl* control = m_buffer.control();
+
+    // Default 50us timer slack would be all of our presentation error
+    prctl(PR_SET_TIMERSLACK, 1UL);
+    m_heartbeat.attach("frames");
+
+    while (!m_stop) {
+        m_heartbeat.busy();
+
+        // Producers timestamp frames with our time base, keep it up to date for them
+        control->clock.store(m_clock->offset(), std::memory_order_relaxed);
+
+        uint32_t seen = control->futex.load();
+        uint32_t middle = control->middle.load();
+        if (middle & LedFrameControl::kFresh) {
+            // Producer can write anything into the control block, slot we don't have is dropped unread
+            uint32_t index = middle & LedFrameControl::kSlotMask;
+            if (index >= LedFrameControl::kSlots) {
+                control->middle.compare_exchange_strong(middle, index);
+                continue;
+            }
+
+            // Our previous front goes back to producer, newest frame becomes our front.
+            // Producer may have published again since we looked, in which case we look again.
+            if (control->middle.compare_exchange_strong(middle, m_front)) {
+                m_front = index;
+                this->receive(m_buffer.slot(m_front), m_clock->now());
+            }
+
+            continue;
+        }
+
+        uint64_t now = m_clock->now();
+        if (!m_queue.empty() && m_queue.front()->present <= now) {
+            this->release(now);
+            continue;
+        }
+
+        // Sleep until next frame arrives or buffered one is due
+        m_heartbeat.idle();
+        m_buffer.wait(seen, m_queue.empty() ? -1 : (int64_t)(m_queue.front()->present - now));
+    }
+
+    m_heartbeat.detach();
+}
+
+// Present frame right away or put it into jitter buffer
+void FrameInput::receive(LedFrameSlot* slot, uint64_t now)
+{
+    if (m_sequence != 0 && slot->sequence > m_sequence + 1) {
+        m_skipped += slot->sequence - m_sequence - 1;
+    }
+
+    m_sequence = slot->sequence;
+
+    uint32_t count = std::min(slot->count, m_buffer.capacity());
+    if (slot->present <= now) {
+        // Anything buffered to be shown before this one is stale now
+        while (!m_queue.empty() && m_queue.front()->present <= slot->present) {
+            m_free.push_back(m_queue.front());
+            m_queue.erase(m_queue.begin());
+            ++m_dropped;
+        }
+
+        this->present(slot->present, slot->base, slot->entries(), count, now);
+        return;
+    }
+
+    if (m_free.empty()) {
+        m_free.push_back(m_queue.front());
+        m_queue.erase(m_queue.begin());
+        ++m_dropped;
+    }
+
+    Frame* frame = m_free.back();
+    m_free.pop_back();
+    frame->present = slot->present;
+    frame->base = slot->base;
+    frame->entries.assign(slot->entries(), slot->entries() + count);
+
+    auto pos = std::upper_bound(m_queue.begin(), m_queue.end(), frame,
+                                [](const Frame* a, const Frame* b) { return a->present < b->present; });
+    m_queue.insert(pos, frame);
+}
+
+// Present newest due frame from jitter buffer, older due ones are dropped
+void FrameInput::release(uint64_t now)
+{
+    Frame* frame = NULL;
+    while (!m_queue.empty() && m_queue.front()->present <= now) {
+        if (frame) {
+            m_free.push_back(frame);
+            ++m_dropped;
+        }
+
+        frame = m_queue.front();
+        m_queue.erase(m_queue.begin());
+    }
+
+    this->present(frame->present, frame->base, frame->entries.data(), frame->entries.size(), now);
+    m_free.push_back(frame);
+}
+
+// Apply frame entry to LED state
+static bool ApplyEntry(const LedFrameEntry& e, LedState& led)
+{
+    unsigned rate = e.rate * 1000u;
+    if (e.color > (uint8_t)LedColor::Blue || rate < LEDSRV_RATE_MIN || rate > LEDSRV_RATE_MAX) {
+        return false;
+    }
+
+    led.state = (e.state != 0);
+    led.color = (LedColor)e.color;
+    led.rate = rate;
+    return true;
+}
+
+// Frame is diffed against current state, only changed LEDs reach the view and everyone watching
+void FrameInput::present(uint64_t present, uint32_t base, const LedFrameEntry* entries, uint32_t count, uint64_t now)
+{
+    {
+        auto guard = LockState();
+
+        // Diffing only reads state, so it can be spread over task pool while we hold the lock
+        m_tasks->parallel_for(0, count, kDiffGrain, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                const LedState& current = GetLedState(base + i);
+                LedState led = current;
+                m_changed[i] = ApplyEntry(entries[i], led) && (current != led);
+            }
+        });
+
+        // Any commit changing more than its own LED has set off rules or derived LEDs,
+        // which may have changed LEDs of this frame that the diff has already passed over
+        bool cascaded = false;
+        for (uint32_t i = 0; i < count; ++i) {
+            if (m_changed[i]) {
+                LedState led = GetLedState(base + i);
+                ApplyEntry(entries[i], led);
+
+                uint64_t version = GetStateVersion();
+                CommitLedState(base + i, led);
+                cascaded |= (GetStateVersion() - version > 1);
+            }
+        }
+
+        // Frame values win, the diff is stale by now so every LED is checked again
+        for (unsigned pass = 1; cascaded && pass < kMaxPasses; ++pass) {
+            cascaded = false;
+            for (uint32_t i = 0; i < count; ++i) {
+                LedState led = GetLedState(base + i);
+                if (ApplyEntry(entries[i], led) && GetLedState(base + i) != led) {
+                    uint64_t version = GetStateVersion();
+                    CommitLedState(base + i, led);
+                    cascaded |= (GetStateVersion() - version > 1);
+                }
+            }
+        }
+    }
+
+    ++m_presented;
+    if (present != 0 && now > present + kLateUsec) {
+        ++m_late;
+    }
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include "frame_buffer.h"
+#include "watchdog.h"
+
+class ClockSync;
+class TaskPool;
+
+/**
+ * \brief   Server side of shared memory frame input.
+ *          A dedicated thread sleeps on the frame futex, picks up the newest frame straight from
+ *          shared memory and commits LEDs which differ from current state, all under a single state lock.
+ *          Large frames are diffed in parallel on task pool, changes are still committed in frame order.
+ *          Entries with invalid color or rate are skipped. Frames only carry state, color and whole HZ rate,
+ *          other blink parameters of framed LEDs are left as they are.
+ *          Rules and derived LEDs reacting to committed changes may change other LEDs of the same frame,
+ *          those get their frame value back in another commit pass. Rules which keep changing them back
+ *          have the last word after kMaxPasses, until the next frame changes those LEDs.
+ *
+ *          Frames with a presentation time in the future are copied into a small jitter buffer
+ *          and released when their time comes, so that uneven submission doesn't show.
+ *          When several buffered frames are due at once, only the newest is presented and the rest
+ *          are dropped, as are the oldest frames when the buffer is full.
+ *
+ *          Presentation times are in server's shared time base, see ClockSync, so that instances
+ *          in the same clock group release frames with the same timestamp together.
+ */
+class FrameInput : boost::noncopyable
+{
+public:
+
+    static const size_t kJitterDepth = 8;       // Frames buffered ahead of time
+    static const uint64_t kLateUsec = 1000;     // Frames presented later than this count as late
+    static const size_t kDiffGrain = 4096;      // LEDs diffed by a single task
+    static const unsigned kMaxPasses = 4;       // Commit passes over a frame while rules keep changing its LEDs
+
+    struct Stats
+    {
+        uint64_t presented;     // Frames presented
+        uint64_t late;          // Presented more than kLateUsec after their presentation time
+        uint64_t dropped;       // Superseded in jitter buffer or pushed out of a full one
+        uint64_t skipped;       // Overwritten by producer before server picked them up
+    };
+
+    FrameInput()
+        : m_clock(NULL), m_tasks(NULL), m_name(NULL), m_front(0), m_sequence(0), m_stop(false), m_presented(0), m_late(0), m_dropped(0), m_skipped(0) {
+    }
+
+    ~FrameInput() {
+        this->stop();
+    }
+
+    /**
+     * \brief   Create frame shared memory.
+     *          Producers can attach and publish right away, frames wait in shared memory until start().
+     *
+     * \name        Shared memory object name
+     * \capacity    Largest frame, in LEDs
+     *
+     * \return  0 on success, negative value on error
+     */
+    int create(const char* name, uint32_t capacity);
+
+    /**
+     * \brief   Start consuming frames, once whatever reacts to LED changes is in place
+     *
+     * \clock       Time base for presentation times
+     * \tasks       Pool to diff large frames on
+     *
+     * \return  0 on success, negative value on error
+     */
+    int start(const ClockSync& clock, TaskPool& tasks);
+
+    /**
+     * \brief   Stop consuming frames and remove shared memory
+     */
+    void stop();
+
+    Stats stats() const;
+
+private:
+
+    struct Frame
+    {
+        uint64_t present;
+        uint32_t base;
+        std::vector<LedFrameEntry> entries;
+    };
+
+    void run();
+    void receive(LedFrameSlot* slot, uint64_t now);
+    void release(uint64_t now);
+    void present(uint64_t present, uint32_t base, const LedFrameEntry* entries, uint32_t count, uint64_t now);
+
+    LedFrameBuffer m_buffer;
+    const ClockSync* m_clock;
+    TaskPool* m_tasks;
+    const char* m_name;
+    uint32_t m_front;               // Slot we're reading from
+    uint64_t m_sequence;            // Last frame number picked up
+
+    std::vector<Frame*> m_queue;    // Jitter buffer in presentation order
+    std::vector<Frame*> m_free;     // Unused jitter buffer frames
+    std::vector<std::unique_ptr<Frame>> m_frames;
+    std::vector<uint8_t> m_changed; // Diff of frame being presented, entry per LED
+
+    std::atomic<bool> m_stop;
+    std::atomic<uint64_t> m_presented;
+    std::atomic<uint64_t> m_late;
+    std::atomic<uint64_t> m_dropped;
+    std::atomic<uint64_t> m_skipped;
+    Heartbeat m_heartbeat;
+    std::thread m_thread;
+};
@@ -0,0 +1,364 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "json.h"
+
+JsonReader::JsonReader(char* data, size_t size)
+    : m_pos(data), m_end(data + size), m_text(NULL), m_length(0), m_stack(0), m_depth(0), m_state(kValue)
+{
+}
+
+bool JsonReader::equals(const char* str) const
+{
+    return (strlen(str) == m_length) && (0 == memcmp(str, m_text, m_length));
+}
+
+void JsonReader::skip_space()
+{
+    while (m_pos < m_end && (*m_pos == ' ' || *m_pos == '\t' || *m_pos == '\r' || *m_pos == '\n')) {
+        ++m_pos;
+    }
+}
+
+JsonReader::Token JsonReader::next()
+{
+    for (;;) {
+        this->skip_space();
+        if (m_state == kDone) {
+            return (m_pos == m_end) ? kEnd : kError;
+        }
+
+        if (m_pos == m_end) {
+            return kError;
+        }
+
+        char c = *m_pos;
+        switch (m_state) {
+        case kColon:
+            if (c != ':') {
+                return kError;
+            }
+
+            ++m_pos;
+            m_state = kValue;
+            continue;
+
+        case kNextOrClose:
+            if (c == ',') {
+                ++m_pos;
+                m_state = this->in_object() ? kMember : kValue;
+                continue;
+            }
+
+            if (c == '}' || c == ']') {
+                ++m_pos;
+                return this->pop(c == '}');
+            }
+
+            return kError;
+
+        case kFirstMember:
+            if (c == '}') {
+                ++m_pos;
+                return this->pop(true);
+            }
+
+            // Fall through
+        case kMember:
+            if (c != '"') {
+                return kError;
+            }
+
+            m_state = kColon;
+            return this->read_string(true);
+
+        case kFirstElement:
+            if (c == ']') {
+                ++m_pos;
+                return this->pop(false);
+            }
+
+            // Fall through
+        case kValue:
+            switch (c) {
+            case '{':   ++m_pos; return this->push(true);
+            case '[':   ++m_pos; return this->push(false);
+            case '"':   return this->value_done(this->read_string(false));
+            case 't':   return this->value_done(this->read_literal("true", kTrue));
+            case 'f':   return this->value_done(this->read_literal("false", kFalse));
+            case 'n':   return this->value_done(this->read_literal("null", kNull));
+            default:    return this->value_done(this->read_number());
+            }
+
+        default:
+            return kError;
+        }
+    }
+}
+
+bool JsonReader::skip()
+{
+    Token token = this->next();
+    if (token != kObjectBegin && token != kArrayBegin) {
+        return token != kError && token != kEnd && token != kKey;
+    }
+
+    unsigned depth = m_depth - 1;
+    while (m_depth > depth) {
+        token = this->next();
+        if (token == kError || token == kEnd) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+JsonReader::Token JsonReader::push(bool object)
+{
+    if (m_depth == kMaxDepth) {
+        return kError;
+    }
+
+    m_stack = object ? (m_stack | (1u << m_depth)) : (m_stack & ~(1u << m_depth));
+    ++m_depth;
+    m_state = object ? kFirstMember : kFirstElement;
+    return object ? kObjectBegin : kArrayBegin;
+}
+
+JsonReader::Token JsonReader::pop(bool object)
+{
+    if (this->in_object() != object) {
+        return kError;
+    }
+
+    --m_depth;
+    return this->value_done(object ? kObjectEnd : kArrayEnd);
+}
+
+JsonReader::Token JsonReader::value_done(Token token)
+{
+    if (token != kError) {
+        m_state = (m_depth == 0) ? kDone : kNextOrClose;
+    }
+
+    return token;
+}
+
+static int HexDigit(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+
+    return -1;
+}
+
+// Parse 4 hex digits of \u escape
+static bool ReadHex4(const char* p, const char* end, uint32_t& cp)
+{
+    if (end - p < 4) {
+        return false;
+    }
+
+    cp = 0;
+    for (int i = 0; i < 4; ++i) {
+        int d = HexDigit(p[i]);
+        if (d < 0) {
+            return false;
+        }
+
+        cp = (cp << 4) | d;
+    }
+
+    return true;
+}
+
+// UTF-8 encoding is never longer than the escape sequence it came from, so it fits in place
+static char* EncodeUtf8(char* out, uint32_t cp)
+{
+    if (cp < 0x80) {
+        *out++ = (char)cp;
+    } else if (cp < 0x800) {
+        *out++ = (char)(0xC0 | (cp >> 6));
+        *out++ = (char)(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        *out++ = (char)(0xE0 | (cp >> 12));
+        *out++ = (char)(0x80 | ((cp >> 6) & 0x3F));
+        *out++ = (char)(0x80 | (cp & 0x3F));
+    } else {
+        *out++ = (char)(0xF0 | (cp >> 18));
+        *out++ = (char)(0x80 | ((cp >> 12) & 0x3F));
+        *out++ = (char)(0x80 | ((cp >> 6) & 0x3F));
+        *out++ = (char)(0x80 | (cp & 0x3F));
+    }
+
+    return out;
+}
+
+JsonReader::Token JsonReader::read_string(bool key)
+{
+    char* p = m_pos + 1;
+    char* start = p;
+    char* out = p;
+
+    for (;;) {
+        if (p == m_end) {
+            return kError;
+        }
+
+        char c = *p++;
+        if (c == '"') {
+            break;
+        }
+
+        if ((unsigned char)c < 0x20) {
+            return kError;
+        }
+
+        if (c != '\\') {
+            *out++ = c;
+            continue;
+        }
+
+        if (p == m_end) {
+            return kError;
+        }
+
+        c = *p++;
+        switch (c) {
+        case '"':   *out++ = '"'; break;
+        case '\\':  *out++ = '\\'; break;
+        case '/':   *out++ = '/'; break;
+        case 'b':   *out++ = '\b'; break;
+        case 'f':   *out++ = '\f'; break;
+        case 'n':   *out++ = '\n'; break;
+        case 'r':   *out++ = '\r'; break;
+        case 't':   *out++ = '\t'; break;
+        case 'u': {
+            uint32_t cp;
+            if (!ReadHex4(p, m_end, cp)) {
+                return kError;
+            }
+
+            p += 4;
+            if (cp >= 0xD800 && cp <= 0xDBFF) {
+                // High surrogate must be followed by low one
+                uint32_t low;
+                if (m_end - p < 6 || p[0] != '\\' || p[1] != 'u' || !ReadHex4(p + 2, m_end, low) || low < 0xDC00 || low > 0xDFFF) {
+                    return kError;
+                }
+
+                p += 6;
+                cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+            } else if (cp >= 0xDC00 && cp <= 0xDFFF) {
+                return kError;
+            }
+
+            out = EncodeUtf8(out, cp);
+            break;
+        }
+        default:
+            return kError;
+        }
+    }
+
+    m_pos = p;
+    m_text = start;
+    m_length = out - start;
+    return key ? kKey : kString;
+}
+
+JsonReader::Token JsonReader::read_number()
+{
+    char* p = m_pos;
+
+    if (p < m_end && *p == '-') {
+        ++p;
+    }
+
+    // Integer part, no leading zeros
+    if (p < m_end && *p == '0') {
+        ++p;
+    } else if (p < m_end && *p >= '1' && *p <= '9') {
+        while (p < m_end && *p >= '0' && *p <= '9') {
+            ++p;
+        }
+    } else {
+        return kError;
+    }
+
+    if (p < m_end && *p == '.') {
+        ++p;
+        if (p == m_end || *p < '0' || *p > '9') {
+            return kError;
+        }
+
+        while (p < m_end && *p >= '0' && *p <= '9') {
+            ++p;
+        }
+    }
+
+    if (p < m_end && (*p == 'e' || *p == 'E')) {
+        ++p;
+        if (p < m_end && (*p == '+' || *p == '-')) {
+            ++p;
+        }
+
+        if (p == m_end || *p < '0' || *p > '9') {
+            return kError;
+        }
+
+        while (p < m_end && *p >= '0' && *p <= '9') {
+            ++p;
+        }
+    }
+
+    m_text = m_pos;
+    m_length = p - m_pos;
+    m_pos = p;
+    return kNumber;
+}
+
+JsonReader::Token JsonReader::read_literal(const char* word, Token token)
+{
+    size_t len = strlen(word);
+    if ((size_t)(m_end - m_pos) < len || 0 != memcmp(m_pos, word, len)) {
+        return kError;
+    }
+
+    m_text = m_pos;
+    m_length = len;
+    m_pos += len;
+    return token;
+}
+
+void JsonAppendString(std::string& out, const char* str, size_t len)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    out.push_back('"');
+    for (size_t i = 0; i < len; ++i) {
+        unsigned char c = str[i];
+        switch (c) {
+        case '"':   out.append("\\\""); break;
+        case '\\':  out.append("\\\\"); break;
+        case '\n':  out.append("\\n"); break;
+        case '\r':  out.append("\\r"); break;
+        case '\t':  out.append("\\t"); break;
+        default:
+            if (c < 0x20) {
+                char esc[] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF] };
+                out.append(esc, sizeof(esc));
+            } else {
+                out.push_back(c);
+            }
+        }
+    }
+
+    out.push_back('"');
+}
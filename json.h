@@ -0,0 +1,107 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <string>
+
+/**
+ * \brief   Streaming pull parser for a single JSON document.
+ *          Parser works on caller's buffer and never allocates: strings are unescaped in place
+ *          and returned as pointers into the buffer, nesting is tracked in a fixed bit stack.
+ *          Separators are validated and consumed internally, caller only sees values and keys.
+ */
+class JsonReader
+{
+public:
+
+    enum Token {
+        kError = 0,
+        kEnd,           // Document is complete
+        kObjectBegin,
+        kObjectEnd,
+        kArrayBegin,
+        kArrayEnd,
+        kKey,           // Object member name, see text()
+        kString,        // See text()
+        kNumber,        // See text(), number is validated but left unparsed
+        kTrue,
+        kFalse,
+        kNull,
+    };
+
+    static const unsigned kMaxDepth = 32;
+
+    /**
+     * \brief   Start parsing document.
+     *          Buffer is modified while strings are unescaped and must outlive the reader.
+     */
+    JsonReader(char* data, size_t size);
+
+    /**
+     * \brief   Read next token
+     */
+    Token next();
+
+    /**
+     * \brief   Skip next value, including nested containers
+     *
+     * \return  False on malformed document
+     */
+    bool skip();
+
+    /**
+     * \brief   Text of last key, string or number token, not NUL terminated
+     */
+    const char* text() const {
+        return m_text;
+    }
+
+    size_t length() const {
+        return m_length;
+    }
+
+    bool equals(const char* str) const;
+
+private:
+
+    enum State {
+        kValue,         // Expecting a value
+        kFirstMember,   // Just after '{', expecting key or '}'
+        kMember,        // Expecting key
+        kColon,         // Expecting ':' after key
+        kFirstElement,  // Just after '[', expecting value or ']'
+        kNextOrClose,   // After a value, expecting ',' or closing bracket
+        kDone,
+    };
+
+    void skip_space();
+    Token read_string(bool key);
+    Token read_number();
+    Token read_literal(const char* word, Token token);
+    Token push(bool object);
+    Token pop(bool object);
+    Token value_done(Token token);
+
+    bool in_object() const {
+        return (m_stack >> (m_depth - 1)) & 1;
+    }
+
+    char* m_pos;
+    char* m_end;
+    const char* m_text;
+    size_t m_length;
+    uint32_t m_stack;   // One bit per nesting level, set for objects
+    unsigned m_depth;
+    State m_state;
+};
+
+/**
+ * \brief   Append str to out as a quoted JSON string
+ */
+extern void JsonAppendString(std::string& out, const char* str, size_t len);
+
+inline void JsonAppendString(std::string& out, const std::string& str)
+{
+    JsonAppendString(out, str.data(), str.size());
+}
@@ -0,0 +1,134 @@
+#include "json.h"
+#include "json_protocol.h"
+
+// Scalars are all fine as command arguments, numbers are passed on as written
+static bool ReadArg(JsonReader& reader, JsonReader::Token token, std::string& arg)
+{
+    switch (token) {
+    case JsonReader::kString:
+    case JsonReader::kNumber:
+    case JsonReader::kTrue:
+    case JsonReader::kFalse:
+        arg.assign(reader.text(), reader.length());
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Parse command object members following its opening brace
+static bool ReadCommand(JsonReader& reader, std::vector<std::string>& argv, JsonRequest* top)
+{
+    std::string cmd;
+    std::string led;
+
+    argv.clear();
+    argv.emplace_back();
+
+    for (;;) {
+        JsonReader::Token token = reader.next();
+        if (token == JsonReader::kObjectEnd) {
+            break;
+        }
+
+        if (token != JsonReader::kKey) {
+            return false;
+        }
+
+        if (reader.equals("cmd")) {
+            if (!ReadArg(reader, reader.next(), argv[0])) {
+                return false;
+            }
+        } else if (reader.equals("led")) {
+            if (!ReadArg(reader, reader.next(), led)) {
+                return false;
+            }
+        } else if (reader.equals("args")) {
+            if (reader.next() != JsonReader::kArrayBegin) {
+                return false;
+            }
+
+            for (token = reader.next(); token != JsonReader::kArrayEnd; token = reader.next()) {
+                argv.emplace_back();
+                if (!ReadArg(reader, token, argv.back())) {
+                    return false;
+                }
+            }
+        } else if (top && reader.equals("id")) {
+            // Id is echoed as it was written, a second one would run into the first
+            if (!top->id.empty()) {
+                return false;
+            }
+
+            token = reader.next();
+            if (token == JsonReader::kString) {
+                JsonAppendString(top->id, reader.text(), reader.length());
+            } else if (token == JsonReader::kNumber || token == JsonReader::kTrue || token == JsonReader::kFalse || token == JsonReader::kNull) {
+                top->id.assign(reader.text(), reader.length());
+            } else {
+                return false;
+            }
+        } else if (top && reader.equals("batch")) {
+            if (reader.next() != JsonReader::kArrayBegin) {
+                return false;
+            }
+
+            top->batch = true;
+            for (token = reader.next(); token != JsonReader::kArrayEnd; token = reader.next()) {
+                top->commands.emplace_back();
+                if (token != JsonReader::kObjectBegin || !ReadCommand(reader, top->commands.back(), NULL)) {
+                    return false;
+                }
+            }
+        } else if (!reader.skip()) {
+            return false;
+        }
+    }
+
+    if (argv[0].empty()) {
+        argv.clear();
+    } else if (!led.empty()) {
+        argv.insert(argv.begin() + 1, led);
+    }
+
+    return true;
+}
+
+bool ParseJsonRequest(std::string& line, JsonRequest& req)
+{
+    req.id.clear();
+    req.batch = false;
+    req.commands.clear();
+
+    JsonReader reader(&line[0], line.size());
+    if (reader.next() != JsonReader::kObjectBegin) {
+        return false;
+    }
+
+    std::vector<std::string> argv;
+    if (!ReadCommand(reader, argv, &req) || reader.next() != JsonReader::kEnd) {
+        return false;
+    }
+
+    if (!req.batch) {
+        req.commands.emplace_back();
+        req.commands.back().swap(argv);
+    }
+
+    return true;
+}
+
+void JsonAppendResult(std::string& out, bool ok, const std::string& value)
+{
+    out.append(ok ? "\"ok\":true" : "\"ok\":false");
+    if (ok && !value.empty()) {
+        out.append(",\"value\":");
+        JsonAppendString(out, value);
+    }
+}
+
+void JsonAppendBusy(std::string& out, unsigned retryMs)
+{
+    out.append("\"ok\":false,\"busy\":true,\"retry_after_ms\":");
+    out.append(std::to_string(retryMs));
+}
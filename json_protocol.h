@@ -0,0 +1,48 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+/**
+ * \brief   Request in JSON-lines protocol, one JSON object per line:
+ *
+ *              {"cmd": "<command>", "led": <address or name>, "args": [<arg>...], "id": <scalar>}
+ *              {"batch": [<request>...], "id": <scalar>}
+ *
+ *          All members but "cmd" are optional, arguments may be strings or numbers.
+ *          Requests are translated into the same argv form as text requests: command, LED, arguments.
+ *          Responses echo "id" if there was one:
+ *
+ *              {"id": <scalar>, "ok": true, "value": "<output>"}
+ *              {"id": <scalar>, "results": [{"ok": false}, ...]}
+ *
+ *          Commands rejected by overloaded server get {"ok": false, "busy": true, "retry_after_ms": <ms>}.
+ *          Bulk commands, outside of batches only, answer with a header object followed by raw payload:
+ *
+ *              {"id": <scalar>, "ok": true, "version": <version>, "bytes": <payload bytes>}
+ *
+ *          Change events for watched LEDs are sent as {"event": <led>, "version": <version>}.
+ */
+struct JsonRequest
+{
+    std::string id;                                 // Request id as JSON text, empty if there was none
+    bool batch;
+    std::vector<std::vector<std::string>> commands; // Argv per command, empty if command was malformed
+};
+
+/**
+ * \brief   Parse JSON request line, line is used as scratch space
+ *
+ * \return  False if line is not a valid request
+ */
+extern bool ParseJsonRequest(std::string& line, JsonRequest& req);
+
+/**
+ * \brief   Append single command result members to out, without enclosing braces
+ */
+extern void JsonAppendResult(std::string& out, bool ok, const std::string& value);
+
+/**
+ * \brief   Append busy result members to out, without enclosing braces
+ */
+extern void JsonAppendBusy(std::string& out, unsigned retryMs);
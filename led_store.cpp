@@ -0,0 +1,71 @@
+#include <algorithm>
+
+#include "led_store.h"
+
+// Position of LED in chunk's packed array
+static inline size_t Rank(uint64_t mask, unsigned bit)
+{
+    return __builtin_popcountll(mask & ((1ull << bit) - 1));
+}
+
+std::vector<LedStore::Chunk>::const_iterator LedStore::find(uint32_t base) const
+{
+    return std::lower_bound(m_chunks.begin(), m_chunks.end(), base,
+                            [](const Chunk& chunk, uint32_t base) { return chunk.base < base; });
+}
+
+std::vector<LedStore::Chunk>::iterator LedStore::find(uint32_t base)
+{
+    return std::lower_bound(m_chunks.begin(), m_chunks.end(), base,
+                            [](const Chunk& chunk, uint32_t base) { return chunk.base < base; });
+}
+
+const LedState& LedStore::get(uint32_t id) const
+{
+    uint32_t base = id >> kChunkShift;
+    unsigned bit = id & kChunkMask;
+
+    auto chunk = this->find(base);
+    if (chunk == m_chunks.end() || chunk->base != base || !(chunk->mask & (1ull << bit))) {
+        return m_default;
+    }
+
+    return chunk->leds[Rank(chunk->mask, bit)];
+}
+
+void LedStore::set(uint32_t id, const LedState& state)
+{
+    uint32_t base = id >> kChunkShift;
+    unsigned bit = id & kChunkMask;
+    bool elide = (state == m_default);
+
+    auto chunk = this->find(base);
+    if (chunk == m_chunks.end() || chunk->base != base) {
+        if (elide) {
+            return;
+        }
+
+        chunk = m_chunks.insert(chunk, Chunk{ base, 0, {} });
+    }
+
+    size_t rank = Rank(chunk->mask, bit);
+    bool present = chunk->mask & (1ull << bit);
+
+    if (elide) {
+        if (present) {
+            chunk->leds.erase(chunk->leds.begin() + rank);
+            chunk->mask &= ~(1ull << bit);
+            --m_size;
+
+            if (chunk->mask == 0) {
+                m_chunks.erase(chunk);
+            }
+        }
+    } else if (present) {
+        chunk->leds[rank] = state;
+    } else {
+        chunk->leds.insert(chunk->leds.begin() + rank, state);
+        chunk->mask |= (1ull << bit);
+        ++m_size;
+    }
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "ledsrv.h"
+
+/**
+ * \brief   Sparse LED state storage addressed by 32-bit LED id.
+ *          LEDs are grouped in chunks of 64 consecutive ids kept in a sorted vector.
+ *          Each chunk holds a presence mask and a packed array of states for LEDs present in it,
+ *          LEDs in default state are not stored at all.
+ *
+ *          Lookup is a binary search over chunks followed by a popcount, so it stays within
+ *          a small factor of a dense array while memory only grows with non-default LEDs.
+ */
+class LedStore
+{
+public:
+
+    explicit LedStore(const LedState& def) : m_default(def), m_size(0) {
+    }
+
+    /**
+     * \brief   Get LED state, LEDs never set are in default state
+     */
+    const LedState& get(uint32_t id) const;
+
+    /**
+     * \brief   Set LED state
+     */
+    void set(uint32_t id, const LedState& state);
+
+    /**
+     * \brief   Visit LEDs in non-default state in ascending id order
+     */
+    template <typename F>
+    void for_each(F func) const
+    {
+        for (const Chunk& chunk : m_chunks) {
+            uint64_t mask = chunk.mask;
+            for (size_t i = 0; mask != 0; ++i, mask &= mask - 1) {
+                uint32_t id = (chunk.base << kChunkShift) | __builtin_ctzll(mask);
+                func(id, chunk.leds[i]);
+            }
+        }
+    }
+
+    const LedState& default_state() const {
+        return m_default;
+    }
+
+    /**
+     * \brief   Number of LEDs in non-default state
+     */
+    size_t size() const {
+        return m_size;
+    }
+
+private:
+
+    static const unsigned kChunkShift = 6;
+    static const uint32_t kChunkMask = (1u << kChunkShift) - 1;
+
+    struct Chunk
+    {
+        uint32_t base;                  // LED id >> kChunkShift
+        uint64_t mask;                  // Bit per LED stored in this chunk
+        std::vector<LedState> leds;     // Packed in id order
+    };
+
+    std::vector<Chunk>::const_iterator find(uint32_t base) const;
+    std::vector<Chunk>::iterator find(uint32_t base);
+
+    LedState m_default;
+    std::vector<Chunk> m_chunks;        // Sorted by base
+    size_t m_size;
+};
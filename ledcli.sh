@@ -1,32 +1,38 @@
 #!/bin/bash
 
-LEDSRV_FIFO_NAME=/tmp/ledsrv
+# Set LEDSRV_INSTANCE to talk to a server started with -i
+LEDSRV_FIFO_NAME=/tmp/ledsrv${LEDSRV_INSTANCE:+.$LEDSRV_INSTANCE}
 LEDSRV_IN_FIFO=/tmp/ledsrv.in.$BASHPID
 LEDSRV_OUT_FIFO=/tmp/ledsrv.out.$BASHPID
 
 if [[ $# < 1 ]]; then
     echo "$0:";
-    echo " get-led-state | set-led-state <on|off>";
-    echo " get-led-color | set-led-color <red|green|blue>";
-    echo " get-led-rate | set-led-rate <1..5>";
+    echo " get-led-state [led] | set-led-state [led] <on|off>";
+    echo " get-led-color [led] | set-led-color [led] <red|green|blue>";
+    echo " get-led-rate [led] | set-led-rate [led] <0.01..60>";
+    echo " get-led-duty [led] | set-led-duty [led] <1..99>";
+    echo " get-led-phase [led] | set-led-phase [led] <0..359>";
+    echo " get-led-group [led] | set-led-group [led] <group|none>";
+    echo " get-led-lit [led]";
+    echo " dump-leds | frame-stats | clock | load-stats | view-stats | stall-stats";
+    echo " <macro> [args...]";
+    echo " led is a numeric LED address or alias, 0 when omitted";
     exit 0;
 fi
 
+# Writing to a missing listener would leave a regular file in its place
+if [[ ! -p $LEDSRV_FIFO_NAME ]]; then
+    echo "$0: $LEDSRV_FIFO_NAME is not there, server is not running" >&2;
+    exit 1;
+fi
+
 # Create our fifos for server and send connection request
 mkfifo $LEDSRV_IN_FIFO
 mkfifo $LEDSRV_OUT_FIFO
 echo $BASHPID > $LEDSRV_FIFO_NAME
 
-case $1 in
-"get-led-state"|"get-led-color"|"get-led-rate") 
-    echo $1 > $LEDSRV_IN_FIFO
-;;
-
-"set-led-state"|"set-led-color"|"set-led-rate") 
-    echo $1 $2 > $LEDSRV_IN_FIFO
-;;
-
-esac
+# Pass request as is, server may have macros configured too
+echo $@ > $LEDSRV_IN_FIFO
 
 cat $LEDSRV_OUT_FIFO
 rm $LEDSRV_IN_FIFO $LEDSRV_OUT_FIFO
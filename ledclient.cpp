@@ -0,0 +1,704 @@
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include "ledsrv.h"
+#include "ledclient.h"
+
+// Connection index for fifo names, unique within process
+static std::atomic<uint32_t> gNextIndex(1);
+
+// Small per-thread number used to pick preferred pool slot
+static size_t ThreadOrdinal(void)
+{
+    static std::atomic<size_t> count(0);
+    static thread_local size_t ordinal = count++;
+    return ordinal;
+}
+
+LedClient::LedClient(unsigned spinUsec /* = 0 */)
+    : m_waiter(spinUsec), m_in(-1), m_out(-1)
+{
+}
+
+LedClient::~LedClient()
+{
+    this->close();
+}
+
+int LedClient::connect(int timeoutMs /* = 1000 */, const char* server /* = LEDSRV_FIFO_NAME */)
+{
+    this->close();
+
+    char buf[64];
+    pid_t pid = getpid();
+    uint32_t index = gNextIndex++;
+
+    snprintf(buf, sizeof(buf), LEDSRV_IN_FIFO LEDSRV_CONN_INDEX, pid, index);
+    m_inName = buf;
+
+    snprintf(buf, sizeof(buf), LEDSRV_OUT_FIFO LEDSRV_CONN_INDEX, pid, index);
+    m_outName = buf;
+
+    const mode_t mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH;
+    if (mkfifo(m_inName.c_str(), mode) != 0 || mkfifo(m_outName.c_str(), mode) != 0) {
+        int err = -errno;
+        this->close();
+        return err;
+    }
+
+    // Our read end has to exist before server opens output fifo for writing
+    m_out = ::open(m_outName.c_str(), O_RDONLY | O_NONBLOCK);
+    if (m_out < 0) {
+        int err = -errno;
+        this->close();
+        return err;
+    }
+
+    // Send connection request, fails right away if there is no server
+    int conn = ::open(server, O_WRONLY | O_NONBLOCK);
+    if (conn < 0) {
+        int err = -errno;
+        this->close();
+        return err;
+    }
+
+    int len = snprintf(buf, sizeof(buf), "%d.%u\n", pid, index);
+    ssize_t res = ::write(conn, buf, len);
+    ::close(conn);
+    if (res != len) {
+        this->close();
+        return -EIO;
+    }
+
+    // Wait for server to open its end of input fifo
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    for (;;) {
+        m_in = ::open(m_inName.c_str(), O_WRONLY | O_NONBLOCK);
+        if (m_in >= 0) {
+            break;
+        }
+
+        if (errno != ENXIO || std::chrono::steady_clock::now() >= deadline) {
+            int err = (errno == ENXIO) ? -ETIMEDOUT : -errno;
+            this->close();
+            return err;
+        }
+
+        usleep(1000);
+    }
+
+    // Requests are small, blocking writes are fine
+    fcntl(m_in, F_SETFL, fcntl(m_in, F_GETFL) & ~O_NONBLOCK);
+    return 0;
+}
+
+void LedClient::close()
+{
+    if (m_in >= 0) {
+        ::close(m_in);
+        m_in = -1;
+    }
+
+    if (m_out >= 0) {
+        ::close(m_out);
+        m_out = -1;
+    }
+
+    if (!m_inName.empty()) {
+        ::unlink(m_inName.c_str());
+        m_inName.clear();
+    }
+
+    if (!m_outName.empty()) {
+        ::unlink(m_outName.c_str());
+        m_outName.clear();
+    }
+
+    m_buffer.clear();
+}
+
+// Wait for more data from server
+int LedClient::receive(int timeoutMs)
+{
+    int res = m_waiter.wait(m_out, timeoutMs);
+    if (res < 0) {
+        return -errno;
+    } else if (res == 0) {
+        return -ETIMEDOUT;
+    }
+
+    char buf[PIPE_BUF];
+    ssize_t bytes = ::read(m_out, buf, sizeof(buf));
+    if (bytes > 0) {
+        m_buffer.append(buf, bytes);
+    } else if (bytes == 0) {
+        return -EPIPE; // Server closed connection
+    } else if (errno != EAGAIN && errno != EINTR) {
+        return -errno;
+    }
+
+    return 0;
+}
+
+// Pass event line to handler, return false if line is not an event
+bool LedClient::dispatch_event(const std::string& line)
+{
+    const size_t len = strlen(LEDSRV_EVENT);
+    if (0 != line.compare(0, len, LEDSRV_EVENT) || line.size() <= len || line[len] != ' ') {
+        return false;
+    }
+
+    if (m_onEvent) {
+        m_onEvent(line.substr(len + 1));
+    }
+
+    return true;
+}
+
+// Read next response line, handling any events in front of it
+int LedClient::read_line(std::string& line, int timeoutMs)
+{
+    uint64_t deadline = MonotonicUsec() + (uint64_t)timeoutMs * 1000;
+
+    for (;;) {
+        size_t end = m_buffer.find('\n');
+        if (end != std::string::npos) {
+            line.assign(m_buffer, 0, end);
+            m_buffer.erase(0, end + 1);
+            if (this->dispatch_event(line)) {
+                continue;
+            }
+
+            return 0;
+        }
+
+        int remaining = -1;
+        if (timeoutMs >= 0) {
+            uint64_t now = MonotonicUsec();
+            remaining = (now < deadline) ? (int)((deadline - now) / 1000) : 0;
+        }
+
+        int err = this->receive(remaining);
+        if (err != 0) {
+            return err;
+        }
+    }
+}
+
+int LedClient::poll_events()
+{
+    if (!this->is_connected()) {
+        return -ENOTCONN;
+    }
+
+    // Only whole events are consumed, anything else stays for read_line
+    for (;;) {
+        size_t end;
+        while ((end = m_buffer.find('\n')) != std::string::npos) {
+            std::string line(m_buffer, 0, end);
+            if (!this->dispatch_event(line)) {
+                return 0;
+            }
+
+            m_buffer.erase(0, end + 1);
+        }
+
+        int err = this->receive(0);
+        if (err == -ETIMEDOUT) {
+            return 0;
+        } else if (err != 0) {
+            this->close();
+            return err;
+        }
+    }
+}
+
+// Write whole buffer to server
+int LedClient::send(const std::string& data)
+{
+    const char* p = data.data();
+    size_t left = data.size();
+    while (left > 0) {
+        ssize_t res = ::write(m_in, p, left);
+        if (res < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            int err = -errno;
+            this->close();
+            return err;
+        }
+
+        p += res;
+        left -= res;
+    }
+
+    return 0;
+}
+
+// Read and parse next response
+int LedClient::read_response(std::string& response, int timeoutMs)
+{
+    std::string line;
+    int err = this->read_line(line, timeoutMs);
+    if (err != 0) {
+        this->close();
+        return err;
+    }
+
+    const size_t okLen = strlen(LEDSRV_STATUS_OK);
+    if (0 == line.compare(0, okLen, LEDSRV_STATUS_OK) && (line.size() == okLen || line[okLen] == ' ')) {
+        response.assign(line, std::min(line.size(), okLen + 1), std::string::npos);
+        return kOk;
+    }
+
+    const size_t busyLen = strlen(LEDSRV_STATUS_BUSY);
+    if (0 == line.compare(0, busyLen, LEDSRV_STATUS_BUSY) && line.size() > busyLen && line[busyLen] == ' ') {
+        response.assign(line, busyLen + 1, std::string::npos);
+        return kBusy;
+    }
+
+    response.clear();
+    return kFailed;
+}
+
+int LedClient::request(const std::string& req, std::string& response, int timeoutMs /* = -1 */)
+{
+    if (!this->is_connected()) {
+        return -ENOTCONN;
+    }
+
+    int err = this->send(req + "\n");
+    if (err != 0) {
+        return err;
+    }
+
+    return this->read_response(response, timeoutMs);
+}
+
+int LedClient::pipeline(const std::vector<std::string>& reqs, size_t& failed, int timeoutMs /* = -1 */)
+{
+    failed = 0;
+    if (!this->is_connected()) {
+        return -ENOTCONN;
+    }
+
+    std::string data;
+    for (auto& req : reqs) {
+        data.append(req);
+        data.append("\n");
+    }
+
+    int err = this->send(data);
+    if (err != 0) {
+        return err;
+    }
+
+    std::string response;
+    for (size_t i = 0; i < reqs.size(); ++i) {
+        int res = this->read_response(response, timeoutMs);
+        if (res < 0) {
+            return res;
+        }
+
+        failed += (res != kOk);
+    }
+
+    return 0;
+}
+
+int LedClient::dump(std::string& dump, uint64_t& version, int timeoutMs /* = -1 */)
+{
+    std::string response;
+    int res = this->request("dump-leds", response, timeoutMs);
+    if (res != kOk) {
+        return res;
+    }
+
+    unsigned long long ver;
+    size_t bytes;
+    if (sscanf(response.c_str(), "%llu %zu", &ver, &bytes) != 2) {
+        this->close(); // Can't tell where dump ends
+        return -EPROTO;
+    }
+
+    version = ver;
+
+    // Whatever was read along with the header, rest goes straight into the dump
+    size_t have = std::min(bytes, m_buffer.size());
+    dump.assign(m_buffer, 0, have);
+    m_buffer.erase(0, have);
+    dump.resize(bytes);
+
+    while (have < bytes) {
+        int res = m_waiter.wait(m_out, timeoutMs);
+        if (res <= 0) {
+            int err = (res == 0) ? -ETIMEDOUT : -errno;
+            this->close();
+            return err;
+        }
+
+        ssize_t len = ::read(m_out, &dump[have], bytes - have);
+        if (len == 0 || (len < 0 && errno != EAGAIN && errno != EINTR)) {
+            int err = (len == 0) ? -EPIPE : -errno;
+            this->close();
+            return err;
+        }
+
+        have += std::max<ssize_t>(len, 0);
+    }
+
+    return kOk;
+}
+
+bool LedClient::ping(int timeoutMs /* = 1000 */)
+{
+    // Any response will do, server turning a query away as busy still answers on this connection
+    std::string response;
+    return this->request("get-led-state", response, timeoutMs) >= 0;
+}
+
+LedClientPool::LedClientPool(size_t size, unsigned healthCheckMs /* = 1000 */, unsigned spinUsec /* = 0 */)
+    : m_healthCheckMs(healthCheckMs), m_parked(0), m_stop(false)
+{
+    for (size_t i = 0; i < std::max<size_t>(size, 1); ++i) {
+        m_slots.emplace_back(new Slot(spinUsec));
+    }
+}
+
+LedClientPool::~LedClientPool()
+{
+    this->stop();
+}
+
+int LedClientPool::start()
+{
+    for (auto& slot : m_slots) {
+        int res = slot->client.connect();
+        if (res != 0) {
+            return res;
+        }
+    }
+
+    m_stop = false;
+    m_checker = std::thread(&LedClientPool::health_check, this);
+    return 0;
+}
+
+void LedClientPool::stop()
+{
+    if (m_checker.joinable()) {
+        {
+            std::lock_guard<std::mutex> guard(m_lock);
+            m_stop = true;
+        }
+
+        m_wake.notify_all();
+        m_checker.join();
+    }
+
+    for (auto& slot : m_slots) {
+        slot->client.close();
+    }
+}
+
+// Take first free slot, starting at the one preferred by calling thread
+LedClientPool::Slot* LedClientPool::try_checkout()
+{
+    size_t count = m_slots.size();
+    size_t first = ThreadOrdinal() % count;
+
+    for (size_t i = 0; i < count; ++i) {
+        Slot* slot = m_slots[(first + i) % count].get();
+
+        bool expected = false;
+        if (slot->busy.compare_exchange_strong(expected, true)) {
+            return slot;
+        }
+    }
+
+    return NULL;
+}
+
+LedClientPool::Slot* LedClientPool::checkout()
+{
+    // Requests are short, a connection is likely to come back soon
+    uint64_t start = MonotonicUsec();
+    do {
+        Slot* slot = this->try_checkout();
+        if (slot) {
+            return slot;
+        }
+
+        std::this_thread::yield();
+    } while (MonotonicUsec() - start < kCheckoutSpinUsec);
+
+    // More threads than connections, sleep until one is checked in.
+    // We're counted as parked before looking again, so checkin either sees us or we see its slot.
+    std::unique_lock<std::mutex> guard(m_parkLock);
+    ++m_parked;
+
+    Slot* slot;
+    while (!(slot = this->try_checkout())) {
+        m_freed.wait(guard);
+    }
+
+    --m_parked;
+    return slot;
+}
+
+void LedClientPool::checkin(Slot* slot)
+{
+    slot->busy.store(false);
+
+    if (m_parked.load() > 0) {
+        std::lock_guard<std::mutex> guard(m_parkLock);
+        m_freed.notify_one();
+    }
+}
+
+int LedClientPool::request(const std::string& req, std::string& response, int timeoutMs /* = -1 */)
+{
+    Slot* slot = this->checkout();
+
+    int res = -ENOTCONN;
+    for (int attempt = 0; attempt < 2 && res < 0; ++attempt) {
+        if (!slot->client.is_connected()) {
+            res = slot->client.connect();
+            if (res != 0) {
+                continue;
+            }
+        }
+
+        res = slot->client.request(req, response, timeoutMs);
+    }
+
+    this->checkin(slot);
+    return res;
+}
+
+void LedClientPool::health_check()
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+
+    while (!m_wake.wait_for(lock, std::chrono::milliseconds(m_healthCheckMs), [this] { return m_stop; })) {
+        lock.unlock();
+
+        // Only look at idle connections, busy ones are evidently working
+        for (auto& slot : m_slots) {
+            bool expected = false;
+            if (!slot->busy.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+                continue;
+            }
+
+            if (!slot->client.is_connected() || !slot->client.ping()) {
+                slot->client.connect();
+            }
+
+            this->checkin(slot.get());
+        }
+
+        lock.lock();
+    }
+}
+
+LedCache::LedCache(unsigned maxStaleMs /* = 1000 */, unsigned spinUsec /* = 0 */)
+    : m_client(spinUsec), m_maxStaleUsec((uint64_t)maxStaleMs * 1000), m_hits(0), m_misses(0)
+{
+    m_client.on_event([this](const std::string& event) { this->invalidate(event); });
+}
+
+int LedCache::connect()
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    m_ids.clear();
+    m_entries.clear();
+    return m_client.connect();
+}
+
+// Event is "<led> <version>", drop everything we know about the LED
+void LedCache::invalidate(const std::string& event)
+{
+    m_entries.erase((uint32_t)strtoul(event.c_str(), NULL, 10));
+}
+
+int LedCache::get(const std::string& led, const std::string& attribute, std::string& value)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    // Lost connection means lost events, start over
+    if (!m_client.is_connected()) {
+        m_ids.clear();
+        m_entries.clear();
+
+        int err = m_client.connect();
+        if (err != 0) {
+            return err;
+        }
+    }
+
+    int err = m_client.poll_events();
+    if (err != 0) {
+        return err;
+    }
+
+    // Subscribe on first use, server reports LED address events will carry
+    auto known = m_ids.find(led);
+    if (known == m_ids.end()) {
+        std::string response;
+        int res = m_client.request("watch-led " + led, response);
+        if (res != LedClient::kOk) {
+            return res;
+        }
+
+        known = m_ids.emplace(led, (uint32_t)strtoul(response.c_str(), NULL, 10)).first;
+    }
+
+    uint64_t now = MonotonicUsec();
+    Attributes& attrs = m_entries[known->second];
+    auto entry = attrs.find(attribute);
+    if (entry != attrs.end() && (now - entry->second.fetched) < m_maxStaleUsec) {
+        ++m_hits;
+        value = entry->second.value;
+        return LedClient::kOk;
+    }
+
+    ++m_misses;
+    int res = m_client.request("get-led-" + attribute + " " + led, value);
+    if (res == LedClient::kOk) {
+        // Events handled while waiting for response may have dropped the LED
+        m_entries[known->second][attribute] = Entry{ value, now };
+    }
+
+    return res;
+}
+
+LedWriteBatcher::LedWriteBatcher(unsigned latencyUsec /* = 1000 */, size_t maxBatch /* = 256 */, unsigned spinUsec /* = 0 */)
+    : m_client(spinUsec), m_latencyUsec(latencyUsec), m_maxBatch(std::max<size_t>(maxBatch, 1)),
+      m_first(0), m_failed(0), m_stop(false)
+{
+}
+
+LedWriteBatcher::~LedWriteBatcher()
+{
+    this->stop();
+}
+
+int LedWriteBatcher::start()
+{
+    {
+        std::lock_guard<std::mutex> guard(m_ioLock);
+        int err = m_client.connect();
+        if (err != 0) {
+            return err;
+        }
+    }
+
+    m_stop = false;
+    m_flusher = std::thread(&LedWriteBatcher::run, this);
+    return 0;
+}
+
+void LedWriteBatcher::stop()
+{
+    if (m_flusher.joinable()) {
+        {
+            std::lock_guard<std::mutex> guard(m_lock);
+            m_stop = true;
+        }
+
+        m_wake.notify_all();
+        m_flusher.join();
+    }
+
+    this->flush();
+
+    std::lock_guard<std::mutex> guard(m_ioLock);
+    m_client.close();
+}
+
+int LedWriteBatcher::set(const std::string& req)
+{
+    bool full = false;
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        if (m_queue.empty()) {
+            m_first = MonotonicUsec();
+            m_wake.notify_all();
+        }
+
+        m_queue.push_back(req);
+        full = (m_queue.size() >= m_maxBatch);
+    }
+
+    // Caller which fills the batch up sends it right away
+    return full ? this->flush() : 0;
+}
+
+int LedWriteBatcher::flush()
+{
+    std::lock_guard<std::mutex> io(m_ioLock);
+
+    std::vector<std::string> batch;
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        batch.swap(m_queue);
+    }
+
+    if (batch.empty()) {
+        return 0;
+    }
+
+    if (!m_client.is_connected()) {
+        int err = m_client.connect();
+        if (err != 0) {
+            m_failed += batch.size();
+            return err;
+        }
+    }
+
+    size_t failed = 0;
+    int err = m_client.pipeline(batch, failed);
+    if (err != 0) {
+        // We don't know which requests made it, count all as failed
+        m_failed += batch.size();
+        return err;
+    }
+
+    m_failed += failed;
+    return (int)failed;
+}
+
+void LedWriteBatcher::run()
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+
+    while (!m_stop) {
+        if (m_queue.empty()) {
+            m_wake.wait(lock);
+            continue;
+        }
+
+        // Wait out latency budget of the oldest queued request
+        uint64_t now = MonotonicUsec();
+        uint64_t deadline = m_first + m_latencyUsec;
+        if (now < deadline) {
+            m_wake.wait_for(lock, std::chrono::microseconds(deadline - now));
+            continue;
+        }
+
+        lock.unlock();
+        this->flush();
+        lock.lock();
+    }
+}
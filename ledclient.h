@@ -0,0 +1,346 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include "ledsrv.h"
+#include "wait_policy.h"
+
+/**
+ * \brief   Single client connection to ledsrv.
+ *          Not thread safe, use LedClientPool to share connections between threads.
+ */
+class LedClient : boost::noncopyable
+{
+public:
+
+    enum Status {
+        kOk = 0,        // Server replied OK
+        kFailed = 1,    // Server replied FAILED
+        kBusy = 2,      // Server is overloaded and rejected request, response holds retry hint in milliseconds
+    };
+
+    /**
+     * \brief   Create client
+     *
+     * \spinUsec    Busy-poll for responses for up to spinUsec before blocking, see WaitPolicy
+     */
+    explicit LedClient(unsigned spinUsec = 0);
+    ~LedClient();
+
+    /**
+     * \brief   Connect to server.
+     *          Every connection gets its own fifo pair, so a process may hold any number of them.
+     *
+     * \timeoutMs   How long to wait for server to pick up the connection
+     * \server      Server listener fifo, instances started with -i listen on LEDSRV_FIFO_NAME.<instance>
+     *
+     * \return  0 on success, negative value on error
+     */
+    int connect(int timeoutMs = 1000, const char* server = LEDSRV_FIFO_NAME);
+
+    /**
+     * \brief   Close connection and remove its fifos
+     */
+    void close();
+
+    bool is_connected() const {
+        return m_in >= 0;
+    }
+
+    /**
+     * \brief   Send request and wait for its response.
+     *          Connection is closed on transport errors.
+     *
+     * \req         Request line without trailing new line
+     * \response    Response payload following status word, if any
+     * \timeoutMs   Response timeout, negative value to wait forever
+     *
+     * \return  kOk, kFailed or kBusy on response, negative value on transport error
+     */
+    int request(const std::string& req, std::string& response, int timeoutMs = -1);
+
+    /**
+     * \brief   Send several requests in one write and wait for all of their responses.
+     *          Connection is closed on transport errors.
+     *
+     * \reqs        Request lines without trailing new lines
+     * \failed      Number of requests server replied FAILED or BUSY to
+     * \timeoutMs   Timeout for every response, negative value to wait forever
+     *
+     * \return  0 when all responses arrived, negative value on transport error
+     */
+    int pipeline(const std::vector<std::string>& reqs, size_t& failed, int timeoutMs = -1);
+
+    /**
+     * \brief   Get state of all LEDs which are not in default state
+     *
+     * \dump        "<led> <on|off> <color> <rate>" line per LED
+     * \version     Server change version dump corresponds to
+     * \timeoutMs   Timeout for every read, negative value to wait forever
+     *
+     * \return  kOk, kFailed or kBusy on response, negative value on transport error
+     */
+    int dump(std::string& dump, uint64_t& version, int timeoutMs = -1);
+
+    /**
+     * \brief   Check that server still responds on this connection.
+     *          Busy server counts as responding, connection is fine and reconnecting wouldn't help.
+     */
+    bool ping(int timeoutMs = 1000);
+
+    /**
+     * \brief   Set handler for change events of watched LEDs.
+     *          Handler gets event line payload following event word and runs on the thread
+     *          which happens to read the event: either waiting for a response or polling for events.
+     */
+    void on_event(std::function<void(const std::string& event)> handler) {
+        m_onEvent = handler;
+    }
+
+    /**
+     * \brief   Handle events which have already arrived, without blocking
+     *
+     * \return  0 on success, negative value on transport error
+     */
+    int poll_events();
+
+private:
+
+    int send(const std::string& data);
+    int read_line(std::string& line, int timeoutMs);
+    int read_response(std::string& response, int timeoutMs);
+    int receive(int timeoutMs);
+    bool dispatch_event(const std::string& line);
+
+    WaitPolicy m_waiter;
+    int m_in;                   // Our end of server input fifo
+    int m_out;                  // Our end of server output fifo
+    std::string m_inName;
+    std::string m_outName;
+    std::string m_buffer;       // Received data not consumed yet
+    std::function<void(const std::string& event)> m_onEvent;
+};
+
+/**
+ * \brief   Thread-safe pool of client connections.
+ *          Every thread prefers its own slot, so with at least as many connections as threads
+ *          each thread keeps using the same connection. Slots are checked out with an atomic flag
+ *          and no lock is taken on request path.
+ *
+ *          When all connections are taken, a thread spins briefly for one to come back and then sleeps
+ *          until a request returns its connection, so extra threads don't burn CPU while they wait.
+ *
+ *          Broken connections are reconnected and idle ones are pinged by a background thread,
+ *          so requests normally find a healthy connection and don't pay for reconnects.
+ */
+class LedClientPool : boost::noncopyable
+{
+public:
+
+    static const unsigned kCheckoutSpinUsec = 50;   // How long to look for a free connection before sleeping
+
+    /**
+     * \brief   Create pool
+     *
+     * \size            Number of connections
+     * \healthCheckMs   Idle connection check period
+     * \spinUsec        Response spin budget for every connection, see WaitPolicy
+     */
+    LedClientPool(size_t size, unsigned healthCheckMs = 1000, unsigned spinUsec = 0);
+    ~LedClientPool();
+
+    /**
+     * \brief   Connect all connections and start health checks
+     *
+     * \return  0 on success, negative value on error
+     */
+    int start();
+
+    /**
+     * \brief   Stop health checks and close all connections
+     */
+    void stop();
+
+    /**
+     * \brief   Send request over a pooled connection.
+     *          Request is retried once on a fresh connection if transport fails.
+     *
+     * \return  LedClient::kOk, LedClient::kFailed or LedClient::kBusy on response, negative value on transport error
+     */
+    int request(const std::string& req, std::string& response, int timeoutMs = -1);
+
+private:
+
+    struct Slot
+    {
+        explicit Slot(unsigned spinUsec) : client(spinUsec), busy(false) {
+        }
+
+        LedClient client;
+        std::atomic<bool> busy;
+    };
+
+    Slot* try_checkout();
+    Slot* checkout();
+    void checkin(Slot* slot);
+    void health_check();
+
+    std::vector<std::unique_ptr<Slot>> m_slots;
+    unsigned m_healthCheckMs;
+
+    std::mutex m_parkLock;          // Only used to sleep while all connections are taken
+    std::condition_variable m_freed;
+    std::atomic<size_t> m_parked;   // Threads sleeping for a connection
+
+    std::thread m_checker;
+    std::mutex m_lock;              // Only used to wait for health check period
+    std::condition_variable m_wake;
+    bool m_stop;
+};
+
+/**
+ * \brief   Client-side cache of LED attributes kept coherent by server subscriptions.
+ *          First read of an LED subscribes to its changes, further reads are served locally
+ *          until server reports a change. Entries also expire after maxStaleMs, which bounds
+ *          staleness even if an event is delayed. Thread safe.
+ */
+class LedCache : boost::noncopyable
+{
+public:
+
+    explicit LedCache(unsigned maxStaleMs = 1000, unsigned spinUsec = 0);
+
+    /**
+     * \brief   Connect cache's own connection to server
+     *
+     * \return  0 on success, negative value on error
+     */
+    int connect();
+
+    /**
+     * \brief   Get LED attribute
+     *
+     * \led         LED address or alias
+     * \attribute   state, color or rate
+     * \value       Attribute value as reported by server
+     *
+     * \return  LedClient::kOk, LedClient::kFailed or LedClient::kBusy, negative value on transport error
+     */
+    int get(const std::string& led, const std::string& attribute, std::string& value);
+
+    uint64_t hits() const {
+        return m_hits;
+    }
+
+    uint64_t misses() const {
+        return m_misses;
+    }
+
+private:
+
+    struct Entry
+    {
+        std::string value;
+        uint64_t fetched;       // MonotonicUsec() when value was read from server
+    };
+
+    typedef std::unordered_map<std::string, Entry> Attributes;
+
+    void invalidate(const std::string& event);
+
+    std::mutex m_lock;
+    LedClient m_client;
+    uint64_t m_maxStaleUsec;
+    std::unordered_map<std::string, uint32_t> m_ids;    // LED reference to address, for watched LEDs
+    std::unordered_map<uint32_t, Attributes> m_entries; // Keyed by LED address
+    uint64_t m_hits;
+    uint64_t m_misses;
+};
+
+/**
+ * \brief   Client-side write batching.
+ *          Set requests are queued and sent as one pipelined write when either the batch fills up
+ *          or the oldest queued request has waited for latency budget. Callers issuing one set per LED
+ *          thus share a single write and a single wakeup on both ends. Thread safe.
+ *
+ *          Requests are fire and forget: set() only reports transport errors of a flush it triggers,
+ *          server failures are counted in failed(). Batch size should stay well below fifo capacity,
+ *          since responses are only read after the whole batch is written.
+ */
+class LedWriteBatcher : boost::noncopyable
+{
+public:
+
+    /**
+     * \brief   Create batcher
+     *
+     * \latencyUsec Longest time a request may stay queued
+     * \maxBatch    Number of requests which triggers immediate flush
+     * \spinUsec    Response spin budget, see WaitPolicy
+     */
+    explicit LedWriteBatcher(unsigned latencyUsec = 1000, size_t maxBatch = 256, unsigned spinUsec = 0);
+    ~LedWriteBatcher();
+
+    /**
+     * \brief   Connect to server and start background flushes
+     *
+     * \return  0 on success, negative value on error
+     */
+    int start();
+
+    /**
+     * \brief   Flush queued requests, stop background flushes and disconnect
+     */
+    void stop();
+
+    /**
+     * \brief   Queue request
+     *
+     * \return  Negative value if this call had to flush and transport failed, non-negative otherwise
+     */
+    int set(const std::string& req);
+
+    /**
+     * \brief   Send queued requests now and wait for their responses
+     *
+     * \return  Number of requests server replied FAILED to, negative value on transport error
+     */
+    int flush();
+
+    /**
+     * \brief   Total number of requests which failed or may have been lost
+     */
+    uint64_t failed() const {
+        return m_failed;
+    }
+
+private:
+
+    void run();
+
+    LedClient m_client;             // Guarded by m_ioLock
+    unsigned m_latencyUsec;
+    size_t m_maxBatch;
+
+    std::mutex m_lock;              // Guards queue
+    std::mutex m_ioLock;            // Serializes flushes
+    std::condition_variable m_wake;
+    std::vector<std::string> m_queue;
+    uint64_t m_first;               // When oldest queued request was queued
+    std::atomic<uint64_t> m_failed;
+    bool m_stop;
+
+    std::thread m_flusher;
+};
@@ -5,20 +5,45 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 #include <limits.h>
 #include <poll.h>
 #include <signal.h>
 
+#include <algorithm>
 #include <vector>
 #include <list>
 #include <exception>
+#include <future>
 #include <stdexcept>
+#include <mutex>
+#include <thread>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/scope_exit.hpp>
 
 #include "ledsrv.h"
+#include "alias_index.h"
+#include "blink.h"
+#include "clock_sync.h"
+#include "config.h"
+#include "derived.h"
+#include "fifo.h"
+#include "frame_input.h"
+#include "json_protocol.h"
+#include "led_store.h"
+#include "macros.h"
+#include "page_buffer.h"
+#include "rules.h"
+#include "state_page.h"
+#include "server.h"
+#include "subscriptions.h"
+#include "task_pool.h"
+#include "view_scheduler.h"
+#include "watchdog.h"
+#include "wait_policy.h"
+#include "worker.h"
 
 #if !defined(countof)
 #   define countof(_a) (sizeof(_a) / sizeof(_a[0]))
@@ -27,286 +52,84 @@
 ////////////////////////////////////////////////////////////////////////////////
 
 //
-// I/O utils
+// LED request handling
 //
 
-namespace {
-
-/**
- * \brief   RAII helper for pipe descriptor
- */
-class Fifo : boost::noncopyable
-{
-public:
-
-    enum Type {
-        kFifoRead = 0,
-        kFifoWrite,
-    };
-
-    enum Flags {
-        kFifoDefault = 0,
-        kFifoDeleteOnClose, // Delete fifo on close
-    };
-    
-    Fifo() : m_fd(-1), m_unlink(false) {
-    }
-
-    ~Fifo() {
-        this->close();
-    }
-
-    /**
-     * \brief   Create a fifo with name and type
-     *          Will block until remote end is opened for appropriate access.
-     *
-     * \return  0 on success, negative value on error
-     */
-    int create(const std::string& name, Type type);
-
-    /**
-     * \brief   Open existing fifo
-     *
-     * \return  0 on success, negative value on error
-     */
-    int open(const std::string& name, Type type, Flags flags = kFifoDefault);
-
-    /**
-     * \brief   Read data from a fifo
-     */
-    ssize_t read(void* data, size_t bytes);
-
-    /**
-     * \brief   Write data to a fifo
-     */
-    ssize_t write(const void* data, size_t bytes);
-
-    /**
-     * \brief   Close fifo.
-     */
-    void close();
-
-    bool is_open() const {
-        return m_fd >= 0;
-    }
+// Guards LED state and view, requests are dispatched from all worker threads
+static std::mutex gStateLock;
 
-    int fd() const {
-        return m_fd;
-    }
-
-    const std::string& name() const {
-        return m_name;
-    }
+// Global LED state, every LED starts in default state
+static LedStore gLedStore({
+    .state = false,
+    .color = LedColor::Red,
+    .rate = 1000,
+    .duty = LEDSRV_DUTY_DEFAULT,
+    .phase = 0,
+    .group = 0,
+});
 
-private:
+// Blink groups, immutable once server is started
+static BlinkScheduler gBlink;
 
-    int m_fd;
-    std::string m_name;
-    bool m_unlink;
-};
+// Time base shared with other instances in the same clock group
+static ClockSync gClock;
 
-int Fifo::create(const std::string& name, Fifo::Type type)
+// Parse decimal number up to max
+static bool ParseNumber(const std::string& arg, unsigned long max, unsigned long& value)
 {
-    // Opening the same fifo?
-    if (name == m_name) {
-        return 0;
-    }
-
-    int res = 0;
-    res = ::access(name.c_str(), F_OK);
-    if (res == 0) {
-        // File exists, check if it's a pipe and remove it
-        struct stat st;
-        res = ::stat(name.c_str(), &st);
-        if (res != 0) {
-            perror("stat failed");
-            return res;
-        }
-
-        if (S_IFIFO & st.st_mode) {
-            res = ::unlink(name.c_str());
-            if (res != 0) {
-                perror("unlink failed");
-                return res;
-            }
-        }
-    }
-
-    res = ::mkfifo(name.c_str(), S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
-    if (res != 0) {
-        perror("mkfifo failed");
-        return res;
-    }
-
-    res = this->open(name, type, kFifoDeleteOnClose);
-    if (res != 0) {
-        ::unlink(name.c_str());
+    if (arg.empty() || !isdigit(arg[0])) {
+        return false;
     }
 
-    return 0;
+    char* end;
+    errno = 0;
+    value = strtoul(arg.c_str(), &end, 10);
+    return (*end == '\0') && (errno == 0) && (value <= max);
 }
 
-int Fifo::open(const std::string& name, Type type, Flags flags /* = kDefault */)
-{
-    int fd = ::open(name.c_str(), (type == kFifoRead ? O_RDONLY : O_WRONLY));
-    if (fd < 0) {
-        return fd;
-    }
+// LED names, immutable once server is started
+static AliasIndex gAliases;
 
-    this->close();
+// Rules reacting to LED changes, immutable once server is started
+static RuleEngine gRules;
 
-    m_fd = fd;
-    m_name = name;
-    m_unlink = (flags == kFifoDeleteOnClose);
-    return 0;
-}
+// LEDs computed from other LEDs, immutable once server is started
+static DerivedLeds gDerived;
 
-void Fifo::close()
-{
-    if (m_fd >= 0) {
-        ::close(m_fd);
-        if (m_unlink) {
-            ::unlink(m_name.c_str());
-        }
+// Named command sequences, immutable once server is started
+static MacroTable gMacros;
 
-        m_fd = -1;
-    }
-}
+// Clients watching LED changes
+static Subscriptions gSubscriptions;
 
-ssize_t Fifo::read(void* data, size_t bytes)
-{
-    assert(data);
-    return ::read(m_fd, data, bytes);
-}
+// Bumped on every LED change
+static uint64_t gVersion = 0;
 
-ssize_t Fifo::write(const void* data, size_t bytes)
-{
-    assert(data);
-    return ::write(m_fd, data, bytes);
-}
+// Shared memory mirror of low LED addresses, if enabled
+static StatePage gStatePage;
 
-/**
- * \brief   RAII helper to hold client connection fifos
- */
-class Connection : boost::noncopyable
-{
-public:
+// Spreads bulk work, frame diffs and dumps, over spare CPUs
+static TaskPool gTasks;
 
-    Connection() {
-    }
+// Shared memory frame input, if enabled
+static FrameInput gFrameInput;
 
-    ~Connection() {
-        this->close();
-    }
+// Names of listener fifo and shared memory objects, suffixed with instance name if there is one
+static std::string gFifoName = LEDSRV_FIFO_NAME;
+static std::string gFrameShmName = LEDSRV_FRAME_SHM;
+static std::string gStateShmName = LEDSRV_STATE_SHM;
 
-    /**
-     * \brief   Init connection to specified client pid
-     *          Will open in and out fifos and block until remote side completes its open.
-     *
-     * \return  0 on success, negative value on error
-     */
-    int open(pid_t pid);
-
-    /**
-     * \brief   Close connection
-     */
-    void close();
-
-    Fifo& in() {
-        return m_in;
-    }
-
-    Fifo& out() {
-        return m_out;
-    }
-
-    // Shortcuts
-    ssize_t read(void* data, size_t bytes) {
-        return m_in.read(data, bytes);
-    }
-
-    ssize_t write(const void* data, size_t bytes) {
-        return m_out.write(data, bytes);
-    }
-
-private:
-
-    Fifo m_in;
-    Fifo m_out;
-};
-
-int Connection::open(pid_t pid)
-{
-    int err = 0;
-    char buf[PATH_MAX] = {0};
-    
-    snprintf(buf, sizeof(buf), LEDSRV_IN_FIFO, pid);
-    err = m_in.open(std::string(buf), Fifo::kFifoRead);
-    if (err < 0) {
-        return err;
-    }
-
-    snprintf(buf, sizeof(buf), LEDSRV_OUT_FIFO, pid);
-    err = m_out.open(std::string(buf), Fifo::kFifoWrite);
-    if (err < 0) {
-        return err;
-    }
-
-    return 0;
-}   
-
-void Connection::close()
-{
-    m_in.close();
-    m_out.close();
-}
-
-} // anonymous namespace 
-
-////////////////////////////////////////////////////////////////////////////////
-
-//
-// LED request handling
-//
-
-// Global LED state
-static LedState gLedState = {
-    .state = false,
-    .color = LedColor::Red,
-    .rate = 1,
-};
-
-bool operator == (const LedState& lhv, const LedState& rhv) 
-{
-    return (lhv.state == rhv.state) && (lhv.color == rhv.color) && (lhv.rate == rhv.rate);
-}
-
-bool operator != (const LedState& lhv, const LedState& rhv) 
-{
-    return !(lhv == rhv);
-}
+// Listener fifo was passed in by supervisor and stays in place when we exit, immutable once server is started
+static bool gInheritedListener = false;
 
 // Led view impl
 std::unique_ptr<ILedView> gLedView;
 
-// Describes supported command. 
-struct LedRequestDesc
-{
-    const char* command;        // Command verb
-    unsigned long nargs;        // Number of arguments this command accepts
+// Draws LED changes to the view at adaptive frame rate
+static ViewScheduler gViewScheduler;
 
-    /**
-     * \brief   Request handler. 
-     *          Normally i'd put function pointers here, but let's have some fun with lambdas.
-     *
-     * \argv    Command name at index 0 followed by any additional arguments
-     * \output  If request generates any output, store it here
-     * \led     Explicit led state to operate on
-     *
-     * \return  True if command was successful, false if anything went wrong.
-     */
-    std::function<bool(const std::vector<std::string>& argv, std::string& output, LedState& led)> handler;
-};
+// Reports threads stuck on a single piece of work
+static Watchdog gWatchdog;
 
 // We know all supported requests at compile time so here's a static list of commands we support 
 static const LedRequestDesc gRequests[] = 
@@ -381,22 +204,96 @@ static const LedRequestDesc gRequests[] =
         [](const std::vector<std::string>& argv, std::string& output, LedState& led)
         { 
             assert(argv.size() == 2);
-            
-            int arg = std::stoi(argv[1]);
-            if (arg < 1 || arg > 5) {
+            return ParseBlinkRate(argv[1], led.rate);
+        }
+    },
+
+    {   
+        "get-led-rate", 0, 
+        [](const std::vector<std::string>& argv, std::string& output, LedState& led)
+        { 
+            output = FormatBlinkRate(led.rate);
+            return true;
+        }
+    },
+
+    {
+        "set-led-duty", 1,
+        [](const std::vector<std::string>& argv, std::string& output, LedState& led)
+        {
+            unsigned long duty;
+            if (!ParseNumber(argv[1], 99, duty) || duty < 1) {
                 return false;
             }
 
-            led.rate = arg;
+            led.duty = (uint8_t)duty;
             return true;
         }
     },
 
-    {   
-        "get-led-rate", 0, 
+    {
+        "get-led-duty", 0,
         [](const std::vector<std::string>& argv, std::string& output, LedState& led)
-        { 
-            output = std::to_string(led.rate);
+        {
+            output = std::to_string(led.duty);
+            return true;
+        }
+    },
+
+    {
+        "set-led-phase", 1,
+        [](const std::vector<std::string>& argv, std::string& output, LedState& led)
+        {
+            unsigned long phase;
+            if (!ParseNumber(argv[1], 359, phase)) {
+                return false;
+            }
+
+            led.phase = (uint16_t)phase;
+            return true;
+        }
+    },
+
+    {
+        "get-led-phase", 0,
+        [](const std::vector<std::string>& argv, std::string& output, LedState& led)
+        {
+            output = std::to_string(led.phase);
+            return true;
+        }
+    },
+
+    {
+        "set-led-group", 1,
+        [](const std::vector<std::string>& argv, std::string& output, LedState& led)
+        {
+            if (argv[1] == "none") {
+                led.group = 0;
+                return true;
+            }
+
+            return gBlink.find(argv[1], led.group);
+        }
+    },
+
+    {
+        "get-led-group", 0,
+        [](const std::vector<std::string>& argv, std::string& output, LedState& led)
+        {
+            output = gBlink.name(led.group);
+            return true;
+        }
+    },
+
+    {
+        // Response is "<on|off> <usec until LED toggles>", computed in shared time so that
+        // instances in the same clock group agree
+        "get-led-lit", 0,
+        [](const std::vector<std::string>& argv, std::string& output, LedState& led)
+        {
+            uint64_t next;
+            bool lit = gBlink.lit(led, gClock.now() - gClock.epoch(), next);
+            output = (lit ? "on " : "off ") + std::to_string(next);
             return true;
         }
     },
@@ -404,123 +301,878 @@ static const LedRequestDesc gRequests[] =
     // Add new command handler here
 };
 
-// Parse and dispatch received request
-static bool DispatchRequest(const std::string& req, std::string& respose)
+// Parse LED address, any 32-bit number
+bool ParseLedId(const std::string& arg, uint32_t& id)
 {
-    std::vector<std::string> argv;
+    if (arg.empty() || !isdigit(arg[0])) {
+        return false;
+    }
+
+    char* end;
+    errno = 0;
+    unsigned long val = strtoul(arg.c_str(), &end, 10);
+    if (*end != '\0' || errno != 0 || val > UINT32_MAX) {
+        return false;
+    }
+
+    id = (uint32_t)val;
+    return true;
+}
+
+// LED references are either addresses or names, names never start with a digit
+bool ResolveLed(const std::string& arg, uint32_t& id)
+{
+    if (!arg.empty() && isdigit(arg[0])) {
+        return ParseLedId(arg, id);
+    }
+
+    return gAliases.lookup(arg, id);
+}
+
+std::unique_lock<std::mutex> LockState(void)
+{
+    return std::unique_lock<std::mutex>(gStateLock);
+}
 
+const LedRequestDesc* FindRequest(const std::string& command, size_t nargs)
+{
+    for (size_t i = 0; i < countof(gRequests); ++i) {
+        const LedRequestDesc* r = &gRequests[i];
+        if ((0 == command.compare(r->command)) && (nargs == r->nargs)) {
+            return r;
+        }
+    }
+
+    return NULL;
+}
+
+// Every command takes an optional LED address or name right after command verb, LED 0 is used when it's omitted
+bool ParseRequest(const std::string& req, LedRequest& parsed)
+{
     // Deconstruct request into command and args, separated by whitespace
     // At least 1 command word should be there
-    boost::split(argv, req, boost::is_space());
-    if (argv.size() < 1) {
+    boost::split(parsed.argv, req, boost::is_space());
+    return ResolveRequest(parsed);
+}
+
+bool ResolveRequest(LedRequest& parsed)
+{
+    if (parsed.argv.size() < 1) {
         return false;
     }
 
-    size_t nargs = argv.size() - 1;
+    size_t nargs = parsed.argv.size() - 1;
 
     // Find request with this command and number of args
-    for (size_t i = 0; i < countof(gRequests); ++i) 
+    parsed.id = 0;
+    parsed.desc = FindRequest(parsed.argv[0], nargs);
+    if (!parsed.desc && nargs > 0) {
+        parsed.desc = FindRequest(parsed.argv[0], nargs - 1);
+        if (!parsed.desc || !ResolveLed(parsed.argv[1], parsed.id)) {
+            return false;
+        }
+
+        parsed.argv.erase(parsed.argv.begin() + 1);
+    }
+
+    return parsed.desc != NULL;
+}
+
+const LedState& GetLedState(uint32_t id)
+{
+    return gLedStore.get(id);
+}
+
+// Store new LED state and let everyone interested know
+void CommitLedState(uint32_t id, const LedState& led)
+{
+    LedState old = gLedStore.get(id);
+    if (old == led) {
+        return; // Update view only when state has changed
+    }
+
+    gViewScheduler.update(id, led);
+    gLedStore.set(id, led);
+
+    uint64_t version = ++gVersion;
+    gStatePage.update(id, led, version);
+    gSubscriptions.notify(id, version);
+    gDerived.on_change(id, old, led);
+    gRules.on_change(id, old, led);
+}
+
+uint64_t GetStateVersion(void)
+{
+    return gVersion;
+}
+
+bool ApplyRequest(const LedRequest& req, std::string& response)
+{
+    LedState led = gLedStore.get(req.id);
+    bool res = req.desc->handler(req.argv, response, led);
+    if (res) {
+        CommitLedState(req.id, led);
+    }
+
+    return res;
+}
+
+// Parse and dispatch received request, anything that is not a command may be a macro
+bool DispatchRequest(const std::string& req, std::string& respose)
+{
+    LedRequest parsed;
+    if (!ParseRequest(req, parsed)) {
+        return gMacros.run(parsed.argv, respose);
+    }
+
+    auto guard = LockState();
+    return ApplyRequest(parsed, respose);
+}
+
+// Read pending '\n'-separated requests from fifo.
+// Several clients may have written before we got to read, so a read can end in the middle of a line:
+// incomplete tail is kept in partial and completed by the next read.
+static bool ReadRequests(Fifo& fifo, std::string& partial, std::vector<std::string>& req)
+{
+    req.clear();
+
+    char buf[PIPE_BUF];
+    ssize_t res = fifo.read(buf, sizeof(buf));
+    if (res < 0) {
+        return (errno == EINTR);
+    }
+
+    partial.append(buf, res);
+
+    // Cut complete lines, skipping empty ones
+    size_t pos = 0;
+    size_t end;
+    while ((end = partial.find('\n', pos)) != std::string::npos) {
+        if (end > pos) {
+            req.emplace_back(partial, pos, end - pos);
+        }
+
+        pos = end + 1;
+    }
+
+    partial.erase(0, pos);
+    return true;
+}
+
+// Describes command operating on client session rather than LED state
+struct SessionRequestDesc
+{
+    const char* command;        // Command verb
+    unsigned long nargs;        // Number of arguments this command accepts
+
+    std::function<bool(const std::vector<std::string>& argv, std::string& output, Worker& worker, Connection& conn)> handler;
+};
+
+static const SessionRequestDesc gSessionRequests[] =
+{
     {
-        const LedRequestDesc* r = &gRequests[i];
-        if ((0 == argv[0].compare(r->command)) && (nargs == r->nargs)) 
+        "watch-led", 1,
+        [](const std::vector<std::string>& argv, std::string& output, Worker& worker, Connection& conn)
+        {
+            uint32_t id;
+            if (!ResolveLed(argv[1], id)) {
+                return false;
+            }
+
+            // Report resolved address and current version so that client can match events
+            auto guard = LockState();
+            gSubscriptions.add(id, &worker, &conn);
+            output = std::to_string(id) + " " + std::to_string(gVersion);
+            return true;
+        }
+    },
+
+    {
+        "unwatch-led", 1,
+        [](const std::vector<std::string>& argv, std::string& output, Worker& worker, Connection& conn)
+        {
+            uint32_t id;
+            if (!ResolveLed(argv[1], id)) {
+                return false;
+            }
+
+            auto guard = LockState();
+            gSubscriptions.remove(id, &conn);
+            return true;
+        }
+    },
+
+    {
+        "protocol", 1,
+        [](const std::vector<std::string>& argv, std::string& output, Worker& worker, Connection& conn)
         {
-            LedState led = gLedState;
-            bool res = r->handler(argv, respose, led);
-            if (res && (led != gLedState)) {
-                gLedView->Update(led); // Update view only when state has changed
-                gLedState = led;
+            Connection::Protocol protocol;
+            if (argv[1] == "text") {
+                protocol = Connection::kProtocolText;
+            } else if (argv[1] == "json") {
+                protocol = Connection::kProtocolJson;
+            } else {
+                return false;
             }
 
-            return res;
+            // Response to this request still goes out in the old protocol
+            conn.set_protocol(protocol);
+            return true;
+        }
+    },
+
+    {
+        "frame-stats", 0,
+        [](const std::vector<std::string>& argv, std::string& output, Worker& worker, Connection& conn)
+        {
+            FrameInput::Stats stats = gFrameInput.stats();
+            output = "presented " + std::to_string(stats.presented) + " late " + std::to_string(stats.late) +
+                     " dropped " + std::to_string(stats.dropped) + " skipped " + std::to_string(stats.skipped);
+            return true;
+        }
+    },
+
+    {
+        // Response is "<shared time> <epoch> <offset> <leader|follower>"
+        "clock", 0,
+        [](const std::vector<std::string>& argv, std::string& output, Worker& worker, Connection& conn)
+        {
+            output = std::to_string(gClock.now()) + " " + std::to_string(gClock.epoch()) + " " +
+                     std::to_string(gClock.offset()) + (gClock.is_leader() ? " leader" : " follower");
+            return true;
+        }
+    },
+
+    {
+        // Response is "frames <n> leds <n> rate <current frame rate, HZ>"
+        "view-stats", 0,
+        [](const std::vector<std::string>& argv, std::string& output, Worker& worker, Connection& conn)
+        {
+            ViewScheduler::Stats stats = gViewScheduler.stats();
+            output = "frames " + std::to_string(stats.frames) + " leds " + std::to_string(stats.leds) +
+                     " rate " + std::to_string(1000000 / std::max<uint64_t>(stats.intervalUsec, 1));
+            return true;
+        }
+    },
+
+    {
+        // Response is "stalls <n> stalled <n> longest <usec>", details of every stall go to stderr
+        "stall-stats", 0,
+        [](const std::vector<std::string>& argv, std::string& output, Worker& worker, Connection& conn)
+        {
+            Watchdog::Stats stats = Watchdog::stats();
+            output = "stalls " + std::to_string(stats.stalls) + " stalled " + std::to_string(stats.stalled) +
+                     " longest " + std::to_string(stats.longestUsec);
+            return true;
+        }
+    },
+
+    {
+        // Overload counters are server wide, delay is the one seen by worker serving this connection
+        "load-stats", 0,
+        [](const std::vector<std::string>& argv, std::string& output, Worker& worker, Connection& conn)
+        {
+            LoadShedder::Stats stats = LoadShedder::stats();
+            output = "shed " + std::to_string(stats.shed) + " episodes " + std::to_string(stats.episodes) +
+                     " overloaded " + std::to_string(stats.overloaded) + " delay " + std::to_string(worker.shedder().delay());
+            return true;
+        }
+    },
+};
+
+// Run session command if request is one
+static bool DispatchSessionRequest(const std::vector<std::string>& argv, std::string& response, Worker& worker, Connection& conn, bool& res)
+{
+    for (size_t i = 0; i < countof(gSessionRequests); ++i) {
+        const SessionRequestDesc* r = &gSessionRequests[i];
+        if ((0 == argv[0].compare(r->command)) && (argv.size() - 1 == r->nargs)) {
+            res = r->handler(argv, response, worker, conn);
+            return true;
         }
     }
-     
+
     return false;
 }
 
-// Read pending '\n'-separated requests from fifo
-// TODO: not sure if it is possible for fifo to accumulate several requests before we are unblocked from read.
-static bool ReadRequests(Fifo& fifo, std::vector<std::string>& req)
+// Dispatch request in argv form, whichever protocol it came in
+static bool DispatchClientRequest(std::vector<std::string>& argv, std::string& response, Worker& worker, Connection& conn)
 {
-    // PIPE_BUF read should be atomic
-    char buf[PIPE_BUF] = {0};
-    if (fifo.read(buf, PIPE_BUF) < 0) {
+    if (argv.empty()) {
         return false;
     }
 
-    std::string input(buf, strnlen(buf, sizeof(buf)));
-    boost::split(req, input, boost::is_any_of("\n"), boost::algorithm::token_compress_on);
+    bool res = false;
+    if (DispatchSessionRequest(argv, response, worker, conn, res)) {
+        return res;
+    }
+
+    LedRequest parsed;
+    parsed.argv.swap(argv);
+    if (!ResolveRequest(parsed)) {
+        return gMacros.run(parsed.argv, response);
+    }
 
-    // split will return an empty trailing request, remove it
-    req.pop_back();
-    return true;
+    auto guard = LockState();
+    return ApplyRequest(parsed, response);
 }
 
-// Process newly connected clients
-// Error are ignored but we should probably handle a lot of things, like remote fifo close, etc.
-static void ProcessClient(Connection& conn)
+void DropClient(Connection& conn)
 {
-    std::vector<std::string> req;
-    if (!ReadRequests(conn.in(), req)) {
+    auto guard = LockState();
+    gSubscriptions.remove_all(&conn);
+}
+
+void TakeEvents(Connection& conn, std::vector<std::pair<uint32_t, uint64_t>>& events)
+{
+    auto guard = LockState();
+    gSubscriptions.take(&conn, events);
+}
+
+// Describes command which writes its own bulk response
+struct BulkRequestDesc
+{
+    const char* command;        // Command verb
+    unsigned long nargs;        // Number of arguments this command accepts
+
+    /**
+     * \brief   Request handler, writes whole response on success
+     *
+     * \id      JSON request id to echo in response header, empty if there is none or connection speaks text
+     *
+     * \return  False if command failed. Connection is failed as well if only part of response was written.
+     */
+    std::function<bool(const std::vector<std::string>& argv, const std::string& id, Connection& conn)> handler;
+};
+
+static const BulkRequestDesc gBulkRequests[] =
+{
+    {
+        // Response is "OK <version> <bytes>", or {"id": <id>, "ok": true, "version": <version>, "bytes": <bytes>}
+        // in JSON, followed by a "<led> <on|off> <color> <rate> <duty> <phase> <group>" line for every LED
+        // in non-default state
+        "dump-leds", 0,
+        [](const std::vector<std::string>& argv, const std::string& id, Connection& conn)
+        {
+            // Copy states out under lock, format without it
+            std::vector<std::pair<uint32_t, LedState>> leds;
+            uint64_t version;
+            {
+                auto guard = LockState();
+                leds.reserve(gLedStore.size());
+                gLedStore.for_each([&leds](uint32_t id, const LedState& led) { leds.emplace_back(id, led); });
+                version = gVersion;
+            }
+
+            static const char* colors[] = { "red", "green", "blue" };
+            static const size_t kMaxLine = 96;
+            static const size_t kGrain = 4096;      // LEDs formatted by a single task
+
+            // Large dumps are formatted in parallel, every chunk into its own part, and parts are joined in order
+            std::vector<std::string> parts((leds.size() + kGrain - 1) / kGrain);
+            gTasks.parallel_for(0, leds.size(), kGrain, [&](size_t begin, size_t end) {
+                std::string& part = parts[begin / kGrain];
+                part.reserve((end - begin) * kMaxLine / 2);
+                for (size_t i = begin; i < end; ++i) {
+                    const LedState& led = leds[i].second;
+                    char line[kMaxLine];
+                    int len = snprintf(line, kMaxLine, "%u %s %s %s %u %u %.32s\n", leds[i].first, led.state ? "on" : "off",
+                                       colors[(int)led.color], FormatBlinkRate(led.rate).c_str(), led.duty, led.phase,
+                                       gBlink.name(led.group).c_str());
+                    part.append(line, std::min<size_t>(len, kMaxLine - 1));
+                }
+            });
+
+            size_t total = 0;
+            for (auto& part : parts) {
+                total += part.size();
+            }
+
+            std::unique_ptr<PageBuffer> dump(new PageBuffer());
+            char* p = (total > 0) ? dump->reserve(total) : NULL;
+            if (total > 0 && !p) {
+                return false;
+            }
+
+            for (auto& part : parts) {
+                memcpy(p, part.data(), part.size());
+                p += part.size();
+            }
+
+            dump->commit(total);
+            if (dump->seal() != 0) {
+                return false;
+            }
+
+            std::string header;
+            char fields[64];
+            if (conn.protocol() == Connection::kProtocolJson) {
+                header = id.empty() ? "{" : "{\"id\":" + id + ",";
+                snprintf(fields, sizeof(fields), "\"ok\":true,\"version\":%llu,\"bytes\":%zu}\n", (unsigned long long)version, dump->size());
+            } else {
+                snprintf(fields, sizeof(fields), LEDSRV_STATUS_OK " %llu %zu\n", (unsigned long long)version, dump->size());
+            }
+
+            header.append(fields);
+
+            // Header without its dump would leave client out of sync, a failed write fails the whole connection
+            return conn.write(header.data(), header.size()) == 0 && conn.splice(std::move(dump)) == 0;
+        }
+    },
+};
+
+// Run bulk command if request is one
+static bool DispatchBulkRequest(const std::vector<std::string>& argv, const std::string& id, Connection& conn, bool& res)
+{
+    for (size_t i = 0; i < countof(gBulkRequests); ++i) {
+        const BulkRequestDesc* r = &gBulkRequests[i];
+        if ((0 == argv[0].compare(r->command)) && (argv.size() - 1 == r->nargs)) {
+            res = r->handler(argv, id, conn);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool IsBuiltinCommand(const std::string& command)
+{
+    for (size_t i = 0; i < countof(gRequests); ++i) {
+        if (0 == command.compare(gRequests[i].command)) {
+            return true;
+        }
+    }
+
+    for (size_t i = 0; i < countof(gSessionRequests); ++i) {
+        if (0 == command.compare(gSessionRequests[i].command)) {
+            return true;
+        }
+    }
+
+    for (size_t i = 0; i < countof(gBulkRequests); ++i) {
+        if (0 == command.compare(gBulkRequests[i].command)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Queries and bulk requests may be turned away under load, anything changing state may not
+static bool IsLowPriority(const std::vector<std::string>& argv)
+{
+    if (argv.empty()) {
+        return false;
+    }
+
+    if (0 == argv[0].compare(0, 4, "get-")) {
+        return true;
+    }
+
+    for (size_t i = 0; i < countof(gBulkRequests); ++i) {
+        if (0 == argv[0].compare(gBulkRequests[i].command)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Text request line gets a single status line, unless it is a bulk request which writes its own response
+static void ProcessTextRequest(const std::string& req, std::string& output, Worker& worker, Connection& conn)
+{
+    std::vector<std::string> argv;
+    boost::split(argv, req, boost::is_space());
+
+    unsigned retryMs;
+    if (!worker.shedder().admit(IsLowPriority(argv), retryMs)) {
+        output.append(LEDSRV_STATUS_BUSY " ");
+        output.append(std::to_string(retryMs));
+        output.append("\n");
+        return;
+    }
+
+    bool res = false;
+    std::string response;
+    if (DispatchBulkRequest(argv, std::string(), conn, res)) {
+        if (res) {
+            return;
+        }
+    } else {
+        res = DispatchClientRequest(argv, response, worker, conn);
+    }
+
+    if (res) {
+        output.append(LEDSRV_STATUS_OK);
+        if (response.length() > 0) {
+            output.append(" ");
+            output.append(response);
+        }
+    } else {
+        output.append(LEDSRV_STATUS_FAILED);
+    }
+
+    output.append("\n");
+}
+
+// JSON request line gets a single JSON object, batches have a result per command
+static void ProcessJsonRequest(std::string& req, JsonRequest& parsed, std::string& output, Worker& worker, Connection& conn)
+{
+    std::string response;
+    unsigned retryMs;
+
+    output.push_back('{');
+    if (!ParseJsonRequest(req, parsed)) {
+        output.append("\"ok\":false,\"error\":\"malformed request\"}\n");
         return;
     }
 
-    for (auto i : req) {
-        std::string response;
-        if (DispatchRequest(i, response)) {
-            std::string output = LEDSRV_STATUS_OK;
-            if (response.length() > 0) {
-                output.append(" ");
-                output.append(response);
+    if (!parsed.id.empty()) {
+        output.append("\"id\":");
+        output.append(parsed.id);
+        output.push_back(',');
+    }
+
+    if (!parsed.batch) {
+        bool res = false;
+        if (!worker.shedder().admit(IsLowPriority(parsed.commands[0]), retryMs)) {
+            JsonAppendBusy(output, retryMs);
+        } else if (!parsed.commands[0].empty() && DispatchBulkRequest(parsed.commands[0], parsed.id, conn, res)) {
+            // Bulk command has written its own response
+            if (res) {
+                output.clear();
+                return;
             }
 
-            output.append("\n");
-            conn.write(output.c_str(), output.length()); 
+            JsonAppendResult(output, false, response);
         } else {
-            const char* failed = LEDSRV_STATUS_FAILED "\n";
-            conn.write(failed, strlen(failed));
+            res = DispatchClientRequest(parsed.commands[0], response, worker, conn);
+            JsonAppendResult(output, res, response);
         }
+
+        output.append("}\n");
+        return;
     }
+
+    // Every command in a batch is admitted on its own, so that state changes in it still get through
+    output.append("\"results\":[");
+    for (size_t i = 0; i < parsed.commands.size(); ++i) {
+        output.append((i > 0) ? ",{" : "{");
+        if (!worker.shedder().admit(IsLowPriority(parsed.commands[i]), retryMs)) {
+            JsonAppendBusy(output, retryMs);
+        } else {
+            response.clear();
+            bool res = DispatchClientRequest(parsed.commands[i], response, worker, conn);
+            JsonAppendResult(output, res, response);
+        }
+
+        output.push_back('}');
+    }
+
+    output.append("]}\n");
+}
+
+// Process pending requests from connected client
+// Client which can't be written to, or leaves too much output unread, is dropped
+bool ProcessClient(Worker& worker, Connection& conn)
+{
+    std::vector<std::string> req;
+    bool open = conn.read_requests(req);
+
+    JsonRequest parsed;
+    std::string output;
+    for (size_t i = 0; i < req.size(); ++i) {
+        output.clear();
+        if (conn.protocol() == Connection::kProtocolJson) {
+            ProcessJsonRequest(req[i], parsed, output, worker, conn);
+        } else {
+            ProcessTextRequest(req[i], output, worker, conn);
+        }
+
+        if (!output.empty() && conn.write(output.c_str(), output.length()) != 0) {
+            return false;
+        }
+
+        // No point serving the rest of the pipeline to a client which won't get the responses
+        if (conn.failed()) {
+            return false;
+        }
+    }
+
+    return open && !conn.failed();
+}
+
+// First descriptor passed following LISTEN_FDS convention
+static const int kListenFdsStart = 3;
+
+// Listener fifo passed in by supervisor, -1 if there is none
+static int InheritedListener()
+{
+    const char* pid = getenv("LISTEN_PID");
+    const char* fds = getenv("LISTEN_FDS");
+    if (!pid || !fds || strtol(pid, NULL, 10) != getpid()) {
+        return -1;
+    }
+
+    // Descriptors are meant for us, not for anything we may start
+    int count = strtol(fds, NULL, 10);
+    unsetenv("LISTEN_PID");
+    unsetenv("LISTEN_FDS");
+    unsetenv("LISTEN_FDNAMES");
+
+    int listener = -1;
+    for (int fd = kListenFdsStart; fd < kListenFdsStart + count; ++fd) {
+        struct stat st;
+        if (listener < 0 && fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode)) {
+            listener = fd;
+            continue;
+        }
+
+        fprintf(stderr, "Ignoring inherited descriptor %d, expecting a single listener fifo\n", fd);
+        close(fd);
+    }
+
+    return listener;
 }
 
 static void inthandler(int s)
 {
-    unlink(LEDSRV_FIFO_NAME);
+    if (!gInheritedListener) {
+        unlink(gFifoName.c_str());
+    }
+
+    shm_unlink(gFrameShmName.c_str());
+    shm_unlink(gStateShmName.c_str());
+}
+
+static void usage(const char* name)
+{
+    printf("%s: [-c config] [-s spin_usec] [-w workers] [-N] [-F leds] [-P leds] [-i instance] [-G group] [-R min:max] [-W ms] [-T threads]\n", name);
+    printf(" -c    Load LED aliases, rules, derived LEDs and macros from config file\n");
+    printf(" -s    Busy-poll for up to spin_usec microseconds before blocking for new requests (default 0)\n");
+    printf(" -w    Number of worker threads serving client connections (default: number of CPUs)\n");
+    printf(" -N    Do not pin workers to NUMA nodes, let the kernel place threads and memory\n");
+    printf(" -F    Accept frames of up to leds LEDs over shared memory " LEDSRV_FRAME_SHM " (default: disabled)\n");
+    printf(" -P    Mirror state of LEDs 0..leds-1 into shared memory " LEDSRV_STATE_SHM " (default: disabled)\n");
+    printf(" -i    Instance name, appended to listener fifo and shared memory names so that instances can run side by side\n");
+    printf(" -G    Share time base with other instances in clock group, frame deadlines follow group time\n");
+    printf(" -R    Range of view frame rates in HZ, rate drops towards min under load (default 10:100)\n");
+    printf(" -W    Report threads busy with a single piece of work for longer than ms, 0 to disable (default 1000)\n");
+    printf(" -T    Task pool threads for frame diffs and dumps, 0 to do them inline (default: number of CPUs - 1)\n");
+    printf("Listener fifo may be passed in by a supervisor following LISTEN_FDS convention, clients queue up in it\n");
+    printf("while server starts or restarts and it is left in place on exit\n");
 }
 
-int main(void)
+int main(int argc, char* argv[])
 {
     int err = 0;
+    unsigned spinUsec = 0;
+    unsigned nworkers = std::max(1u, std::thread::hardware_concurrency());
+    bool numa = true;
+    const char* configPath = NULL;
+    uint32_t frameLeds = 0;
+    uint32_t pageLeds = 0;
+    const char* clockGroup = NULL;
+    unsigned viewMinHz = 10;
+    unsigned viewMaxHz = 100;
+    unsigned stallMs = 1000;
+    unsigned ntasks = std::max(1u, std::thread::hardware_concurrency()) - 1; // Callers work on their loops too
+
+    int opt;
+    while ((opt = getopt(argc, argv, "c:s:w:NF:P:i:G:R:W:T:h")) != -1) {
+        switch (opt) {
+        case 'c':
+            configPath = optarg;
+            break;
+        case 's':
+            spinUsec = strtoul(optarg, NULL, 10);
+            break;
+        case 'w':
+            nworkers = std::max(1ul, strtoul(optarg, NULL, 10));
+            break;
+        case 'N':
+            numa = false;
+            break;
+        case 'F':
+            frameLeds = strtoul(optarg, NULL, 10);
+            break;
+        case 'P':
+            pageLeds = strtoul(optarg, NULL, 10);
+            break;
+        case 'i':
+            gFifoName = gFifoName + "." + optarg;
+            gFrameShmName = gFrameShmName + "." + optarg;
+            gStateShmName = gStateShmName + "." + optarg;
+            break;
+        case 'G':
+            clockGroup = optarg;
+            break;
+        case 'R':
+            if (sscanf(optarg, "%u:%u", &viewMinHz, &viewMaxHz) != 2) {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'W':
+            stallMs = strtoul(optarg, NULL, 10);
+            break;
+        case 'T':
+            ntasks = strtoul(optarg, NULL, 10);
+            break;
+        default:
+            usage(argv[0]);
+            return (opt == 'h') ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    // Take over inherited listener before anything else gets a descriptor,
+    // otherwise create it right away so that clients queue up in it while we start
+    Fifo connFifo;
+    int listener = InheritedListener();
+    if (listener >= 0 && connFifo.adopt(listener) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    gInheritedListener = connFifo.is_open();
+    if (!gInheritedListener) {
+        err = connFifo.create(gFifoName, Fifo::kFifoReadWrite);
+        if (err != 0) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (gTasks.start(ntasks) != 0) {
+        return EXIT_FAILURE;
+    }
 
-    gLedView = CreateLedView();
-    if (!gLedView) {
+    // View comes up on scheduler thread, changes made before it's there are drawn in the first frame
+    err = gViewScheduler.start([]() -> ILedView* {
+        gLedView = CreateLedView();
+        if (gLedView) {
+            gLedView->Update(0, gLedStore.default_state());
+        }
+
+        return gLedView.get();
+    }, viewMinHz, viewMaxHz, frameLeds);
+
+    if (err == -EINVAL) {
+        fprintf(stderr, "Invalid frame rate range %u:%u\n", viewMinHz, viewMaxHz);
+    }
+
+    if (err != 0) {
         return EXIT_FAILURE;
     }
 
-    gLedView->Update(gLedState);
+    // Shared memory subsystems come up in the background while we load configuration and serve requests,
+    // server carries on without the ones that fail
+    std::future<void> page = std::async(std::launch::async, [&]() {
+        if (pageLeds > 0) {
+            if (gStatePage.create(gStateShmName.c_str(), pageLeds, gLedStore.default_state()) != 0) {
+                fprintf(stderr, "State page is not available\n");
+                return;
+            }
+
+            auto guard = LockState();
+            gStatePage.sync(gLedStore, gVersion);
+        }
+    });
+
+    // Frames change LED state, so they are only consumed once configuration is loaded, see below
+    std::future<bool> frames = std::async(std::launch::async, [&]() {
+        if (clockGroup && gClock.start(clockGroup) != 0) {
+            fprintf(stderr, "Failed to join clock group %s\n", clockGroup);
+            return false;
+        }
+
+        if (frameLeds > 0 && gFrameInput.create(gFrameShmName.c_str(), frameLeds) != 0) {
+            fprintf(stderr, "Frame input is not available\n");
+            return false;
+        }
+
+        return frameLeds > 0;
+    });
+
+    ServerConfig config;
+    if (configPath && LoadConfig(configPath, config) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    if (gAliases.build(config.aliases) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    // Rules and derived LEDs may refer to blink groups, groups go first
+    for (auto& group : config.blinkGroups) {
+        if (gBlink.add(group) != 0) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    for (auto& rule : config.rules) {
+        if (gRules.add(rule) != 0) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    for (auto& derivation : config.derived) {
+        if (gDerived.add(derivation) != 0) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    for (auto& macro : config.macros) {
+        if (gMacros.add(macro) != 0) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    {
+        auto guard = LockState();
+        if (gDerived.start() != 0) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Rules and derived LEDs are in place, frames published in the meantime are picked up
+    // as soon as frame input is up. It may still be coming up, requests are served meanwhile.
+    std::future<void> input = std::async(std::launch::async, [&]() {
+        if (frames.get() && gFrameInput.start(gClock, gTasks) != 0) {
+            fprintf(stderr, "Frame input is not available\n");
+        }
+    });
     
     signal(SIGINT, inthandler);
+    signal(SIGPIPE, SIG_IGN); // Clients may go away while we're writing a response
 
-    Fifo connFifo;
-    err = connFifo.create(LEDSRV_FIFO_NAME, Fifo::kFifoRead);
-    if (err != 0) {
+    if (stallMs > 0 && gWatchdog.start(stallMs) != 0) {
         return EXIT_FAILURE;
     }
 
-    // Wait for incoming PIDs on connection fifo separated by new line chars
+    WorkerPool workers;
+    if (workers.start(nworkers, spinUsec, numa) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    // Wait for incoming client ids on connection fifo separated by new line chars
+    // and hand them over to workers
+    WaitPolicy waiter(spinUsec);
+    Heartbeat heartbeat;
+    heartbeat.attach("acceptor");
+
     std::vector<std::string> req;
-    while (ReadRequests(connFifo, req)) {
+    std::string partial;
+    while ((waiter.wait(connFifo.fd()) > 0) && ReadRequests(connFifo, partial, req)) {
+        heartbeat.busy();
         for (auto i : req) {
-            int pid = std::stoi(i);
-
-            Connection conn;
-            err = conn.open(pid);
-            if (err) {
-                return EXIT_FAILURE;
+            ClientId id;
+            if (!id.parse(i)) {
+                fprintf(stderr, "Invalid connection request '%s'\n", i.c_str());
+                continue;
             }
 
-            ProcessClient(conn);
+            workers.post(id);
         }
+
+        heartbeat.idle();
     }
 
     return EXIT_SUCCESS;
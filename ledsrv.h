@@ -1,13 +1,23 @@
 #pragma once
 
+#include <stdint.h>
+
 #include <boost/noncopyable.hpp>
 #include <memory>
 
 #define LEDSRV_FIFO_NAME            "/tmp/ledsrv"
 #define LEDSRV_IN_FIFO              "/tmp/ledsrv.in.%d"
 #define LEDSRV_OUT_FIFO             "/tmp/ledsrv.out.%d"
+#define LEDSRV_CONN_INDEX           ".%u"   // Appended to fifo names of additional connections from the same process
 #define LEDSRV_STATUS_OK            "OK"
 #define LEDSRV_STATUS_FAILED        "FAILED"
+#define LEDSRV_STATUS_BUSY          "BUSY"  // Rejected under load, followed by retry hint in milliseconds
+#define LEDSRV_EVENT                "EVENT" // Unsolicited change notification for watched LEDs
+#define LEDSRV_FRAME_SHM            "/ledsrv.frames"    // Shared memory frame input, see LedFrameProducer
+#define LEDSRV_STATE_SHM            "/ledsrv.state"     // Shared memory state page, see LedStatePageReader
+#define LEDSRV_RATE_MIN             10      // Slowest blink rate, mHz
+#define LEDSRV_RATE_MAX             60000   // Fastest blink rate, mHz
+#define LEDSRV_DUTY_DEFAULT         50      // Blink duty cycle, percent
 
 /**
  * \brief   Possible LED colors
@@ -26,9 +36,23 @@ struct LedState
 {
     bool state;         // On/Off
     LedColor color;     // Current color
-    unsigned rate;      // Blink rate in HZ [0..5]
+    unsigned rate;      // Blink rate in mHz [LEDSRV_RATE_MIN..LEDSRV_RATE_MAX]
+    uint8_t duty;       // Lit share of blink period in percent [1..99]
+    uint16_t phase;     // Blink phase offset in degrees [0..359]
+    uint16_t group;     // Phase-locked blink group, 0 if none
 };
 
+inline bool operator == (const LedState& lhv, const LedState& rhv)
+{
+    return (lhv.state == rhv.state) && (lhv.color == rhv.color) && (lhv.rate == rhv.rate) &&
+           (lhv.duty == rhv.duty) && (lhv.phase == rhv.phase) && (lhv.group == rhv.group);
+}
+
+inline bool operator != (const LedState& lhv, const LedState& rhv)
+{
+    return !(lhv == rhv);
+}
+
 /**
  * \brief   Led view interface. 
  *          Abstracts led display.
@@ -39,8 +63,11 @@ public:
 
     /**
      * \brief   Update display based on new led state
+     *
+     * \id      LED address
+     * \state   New LED state
      */
-    virtual void Update(const LedState& state) = 0;
+    virtual void Update(uint32_t id, const LedState& state) = 0;
     virtual ~ILedView() {};
 };
 
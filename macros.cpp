@@ -0,0 +1,153 @@
+#include <stdio.h>
+
+#include <exception>
+#include <map>
+
+#include <boost/algorithm/string.hpp>
+
+#include "macros.h"
+
+#define MACRO_MAX_PARAMS    9
+
+// Parameter number for '$N' tokens, 0 for anything else
+static int ParamIndex(const std::string& token)
+{
+    if (token.size() == 2 && token[0] == '$' && token[1] >= '1' && token[1] <= '0' + MACRO_MAX_PARAMS) {
+        return token[1] - '0';
+    }
+
+    return 0;
+}
+
+int MacroTable::add(const std::string& text)
+{
+    std::string trimmed = boost::trim_copy(text);
+
+    size_t space = trimmed.find_first_of(" \t");
+    if (space == std::string::npos) {
+        fprintf(stderr, "Invalid macro '%s'\n", trimmed.c_str());
+        return -1;
+    }
+
+    std::string name = trimmed.substr(0, space);
+    if (IsBuiltinCommand(name) || m_macros.count(name)) {
+        fprintf(stderr, "Macro name '%s' is already taken\n", name.c_str());
+        return -1;
+    }
+
+    std::vector<std::string> commands;
+    std::string body = trimmed.substr(space + 1);
+    boost::split(commands, body, boost::is_any_of(";"));
+
+    Macro macro;
+    macro.nparams = 0;
+
+    for (auto& command : commands) {
+        boost::trim(command);
+
+        std::vector<std::string> argv;
+        boost::split(argv, command, boost::is_space(), boost::algorithm::token_compress_on);
+        if (argv[0].empty()) {
+            fprintf(stderr, "Empty command in macro '%s'\n", name.c_str());
+            return -1;
+        }
+
+        // Same lookup as ParseRequest, but LED reference may be a parameter
+        Step step;
+        step.led = 0;
+        step.request.id = 0;
+        step.request.desc = FindRequest(argv[0], argv.size() - 1);
+        if (!step.request.desc && argv.size() > 1) {
+            step.request.desc = FindRequest(argv[0], argv.size() - 2);
+            if (step.request.desc) {
+                step.led = ParamIndex(argv[1]);
+                if (!step.led && !ResolveLed(argv[1], step.request.id)) {
+                    fprintf(stderr, "Unknown LED '%s' in macro '%s'\n", argv[1].c_str(), name.c_str());
+                    return -1;
+                }
+
+                argv.erase(argv.begin() + 1);
+            }
+        }
+
+        if (!step.request.desc) {
+            fprintf(stderr, "Invalid command '%s' in macro '%s'\n", command.c_str(), name.c_str());
+            return -1;
+        }
+
+        for (size_t i = 1; i < argv.size(); ++i) {
+            int param = ParamIndex(argv[i]);
+            if (param) {
+                step.params.emplace_back(i, param);
+                macro.nparams = std::max<size_t>(macro.nparams, param);
+            }
+        }
+
+        macro.nparams = std::max<size_t>(macro.nparams, step.led);
+        step.request.argv = argv;
+        macro.steps.push_back(step);
+    }
+
+    m_macros[name] = macro;
+    return 0;
+}
+
+bool MacroTable::run(const std::vector<std::string>& argv, std::string& response) const
+{
+    if (argv.empty()) {
+        return false;
+    }
+
+    auto found = m_macros.find(argv[0]);
+    if (found == m_macros.end() || found->second.nparams != argv.size() - 1) {
+        return false;
+    }
+
+    const Macro& macro = found->second;
+
+    // Substitute parameters
+    std::vector<LedRequest> requests;
+    for (const Step& step : macro.steps) {
+        requests.push_back(step.request);
+
+        LedRequest& request = requests.back();
+        if (step.led && !ResolveLed(argv[step.led], request.id)) {
+            return false;
+        }
+
+        for (auto& param : step.params) {
+            request.argv[param.first] = argv[param.second];
+        }
+    }
+
+    auto guard = LockState();
+
+    // Dry run on scratch state so that we either run everything or nothing
+    try {
+        std::map<uint32_t, LedState> scratch;
+        for (const LedRequest& request : requests) {
+            auto led = scratch.emplace(request.id, GetLedState(request.id)).first;
+
+            std::string output;
+            if (!request.desc->handler(request.argv, output, led->second)) {
+                return false;
+            }
+        }
+    } catch (const std::exception&) {
+        return false;
+    }
+
+    for (const LedRequest& request : requests) {
+        std::string output;
+        ApplyRequest(request, output);
+        if (!output.empty()) {
+            if (!response.empty()) {
+                response.append(" ");
+            }
+
+            response.append(output);
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include "server.h"
+
+/**
+ * \brief   Named command sequences registered at startup:
+ *
+ *              <name> <command> [args...] [; <command> [args...]]...
+ *
+ *          Arguments and LED references may be parameters $1..$9, substituted by invocation arguments:
+ *
+ *              <name> [args...]
+ *
+ *          Commands are parsed once when macro is added, invocation only substitutes parameters.
+ *          Macro runs atomically under a single state lock. All commands are checked against scratch
+ *          copies of LED state first, so a failing command leaves no partial changes behind.
+ */
+class MacroTable : boost::noncopyable
+{
+public:
+
+    /**
+     * \brief   Parse and add a macro.
+     *          Macros are only added at startup, before clients are served.
+     *
+     * \return  0 on success, negative value on error
+     */
+    int add(const std::string& text);
+
+    /**
+     * \brief   Run macro invocation request.
+     *          Takes state lock.
+     *
+     * \argv    Macro name followed by invocation arguments
+     *
+     * \return  True if request names a macro with matching number of arguments and all of its commands succeeded
+     */
+    bool run(const std::vector<std::string>& argv, std::string& response) const;
+
+private:
+
+    struct Step
+    {
+        LedRequest request;                         // Request with parameters left blank
+        int led;                                    // Parameter holding LED reference, 0 if LED is fixed
+        std::vector<std::pair<size_t, int>> params; // Request argument index to parameter
+    };
+
+    struct Macro
+    {
+        std::vector<Step> steps;
+        size_t nparams;
+    };
+
+    std::unordered_map<std::string, Macro> m_macros;
+};
@@ -0,0 +1,56 @@
+#include <algorithm>
+
+#include "overload.h"
+#include "wait_policy.h"
+
+static std::atomic<uint64_t> gShed(0);
+static std::atomic<uint64_t> gEpisodes(0);
+static std::atomic<uint64_t> gOverloaded(0);
+
+void LoadShedder::begin(uint64_t now)
+{
+    // Worker can only sit idle with nothing queued, idle time drains the estimate
+    uint64_t idle = (now > m_last) ? now - m_last : 0;
+    m_delay = (m_delay > idle) ? m_delay - idle : 0;
+    m_start = now;
+}
+
+void LoadShedder::next(size_t backlog)
+{
+    // Connections served earlier in the batch are what this one waited for
+    m_last = MonotonicUsec();
+    m_wait = m_last - m_start;
+    m_delay = (m_delay * 7 + m_wait) / 8;
+
+    // Average only smooths what's reported, fresh batch with nothing behind it ends overload right away
+    if (!m_overloaded && (m_wait > kTargetUsec || backlog > kMaxReady)) {
+        m_overloaded = true;
+        gEpisodes.fetch_add(1, std::memory_order_relaxed);
+        gOverloaded.fetch_add(1, std::memory_order_relaxed);
+    } else if (m_overloaded && m_wait < kTargetUsec / 2 && backlog < kMaxReady / 2) {
+        // Leave at half the threshold so that we don't flap around it
+        m_overloaded = false;
+        gOverloaded.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+bool LoadShedder::admit(bool low, unsigned& retryMs)
+{
+    if (!m_overloaded || !low) {
+        return true;
+    }
+
+    // Give the queue about twice the time it has taken to build up
+    retryMs = std::min<uint64_t>(std::max<uint64_t>(std::max(m_wait, m_delay) * 2 / 1000, kRetryMinMs), kRetryMaxMs);
+    gShed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+LoadShedder::Stats LoadShedder::stats()
+{
+    Stats stats;
+    stats.shed = gShed.load(std::memory_order_relaxed);
+    stats.episodes = gEpisodes.load(std::memory_order_relaxed);
+    stats.overloaded = gOverloaded.load(std::memory_order_relaxed);
+    return stats;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <atomic>
+
+#include <boost/noncopyable.hpp>
+
+/**
+ * \brief   Per-worker overload detector.
+ *          Worker is overloaded when clients queue up behind each other: either too many connections
+ *          are ready at once, or time between worker waking up and getting to a connection goes above target.
+ *          A connection's own pipeline doesn't count, requests it sent together wait for each other
+ *          whatever the load. While overloaded, low priority requests are rejected right away with
+ *          a retry hint instead of adding to the queue, state changes are always served.
+ */
+class LoadShedder : boost::noncopyable
+{
+public:
+
+    static const size_t kMaxReady = 32;             // Ready connections worker may have waiting before it's overloaded
+    static const uint64_t kTargetUsec = 5000;       // Acceptable queueing delay
+    static const unsigned kRetryMinMs = 10;
+    static const unsigned kRetryMaxMs = 1000;
+
+    /**
+     * \brief   Counters summed over all workers
+     */
+    struct Stats
+    {
+        uint64_t shed;      // Requests rejected as busy
+        uint64_t episodes;  // Times any worker became overloaded
+        uint64_t overloaded;// Workers overloaded right now
+    };
+
+    LoadShedder() : m_start(0), m_last(0), m_wait(0), m_delay(0), m_overloaded(false) {
+    }
+
+    /**
+     * \brief   Worker woke up to handle a batch of events
+     */
+    void begin(uint64_t now);
+
+    /**
+     * \brief   Worker got to next ready connection in this batch
+     *
+     * \backlog     Ready connections worker has yet to get to after this one
+     */
+    void next(size_t backlog);
+
+    /**
+     * \brief   Decide whether to serve next request of current connection
+     *
+     * \low         Request may be rejected under load
+     * \retryMs     Receives retry hint for rejected request
+     *
+     * \return  False if request should be rejected as busy
+     */
+    bool admit(bool low, unsigned& retryMs);
+
+    /**
+     * \brief   Average queueing delay seen by this worker
+     */
+    uint64_t delay() const {
+        return m_delay;
+    }
+
+    static Stats stats();
+
+private:
+
+    uint64_t m_start;       // When current batch started
+    uint64_t m_last;        // When worker got to last connection
+    uint64_t m_wait;        // Time current connection waited for worker, usec
+    uint64_t m_delay;       // Moving average of queueing delay, usec
+    bool m_overloaded;
+};
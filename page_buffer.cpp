@@ -0,0 +1,44 @@
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <algorithm>
+
+#include "page_buffer.h"
+
+PageBuffer::~PageBuffer()
+{
+    if (m_data) {
+        munmap(m_data, m_capacity);
+    }
+}
+
+char* PageBuffer::reserve(size_t bytes)
+{
+    if (m_capacity - m_size >= bytes) {
+        return m_data + m_size;
+    }
+
+    static const size_t page = sysconf(_SC_PAGESIZE);
+
+    // Grow geometrically, remapping moves page tables rather than data
+    size_t capacity = std::max(m_capacity * 2, (m_size + bytes + page - 1) & ~(page - 1));
+    void* mem = m_data ? mremap(m_data, m_capacity, capacity, MREMAP_MAYMOVE)
+                       : mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        return NULL;
+    }
+
+    m_data = static_cast<char*>(mem);
+    m_capacity = capacity;
+    return m_data + m_size;
+}
+
+int PageBuffer::seal()
+{
+    if (m_data && mprotect(m_data, m_capacity, PROT_READ) != 0) {
+        return -errno;
+    }
+
+    return 0;
+}
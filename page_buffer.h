@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <boost/noncopyable.hpp>
+
+/**
+ * \brief   Page-aligned buffer for bulk responses.
+ *          Buffer gets fresh anonymous pages, grows by remapping and is write-protected once sealed.
+ *          Sealed pages never change, so they can be handed to a pipe with vmsplice: the pipe holds
+ *          references to the pages and reader gets them without server copying the data into the pipe.
+ *          Unmapping is fine after that, pages live on until the pipe lets go of them.
+ */
+class PageBuffer : boost::noncopyable
+{
+public:
+
+    PageBuffer() : m_data(NULL), m_size(0), m_capacity(0) {
+    }
+
+    ~PageBuffer();
+
+    /**
+     * \brief   Get room for at least bytes at the end of buffer, see commit()
+     *
+     * \return  Pointer to free space, NULL if buffer could not grow
+     */
+    char* reserve(size_t bytes);
+
+    /**
+     * \brief   Add bytes written to reserved space to buffer contents
+     */
+    void commit(size_t bytes) {
+        m_size += bytes;
+    }
+
+    /**
+     * \brief   Make buffer contents immutable
+     *
+     * \return  0 on success, negative value on error
+     */
+    int seal();
+
+    const char* data() const {
+        return m_data;
+    }
+
+    size_t size() const {
+        return m_size;
+    }
+
+private:
+
+    char* m_data;
+    size_t m_size;
+    size_t m_capacity;
+};
@@ -0,0 +1,74 @@
+#include <stdio.h>
+
+#include <boost/algorithm/string.hpp>
+
+#include "rules.h"
+
+int RuleEngine::add(const std::string& text)
+{
+    std::vector<std::string> argv;
+    std::string trimmed = boost::trim_copy(text);
+    boost::split(argv, trimmed, boost::is_space(), boost::algorithm::token_compress_on);
+    if (argv.size() < 4) {
+        fprintf(stderr, "Invalid rule '%s'\n", trimmed.c_str());
+        return -1;
+    }
+
+    uint32_t watch;
+    if (!ResolveLed(argv[0], watch)) {
+        fprintf(stderr, "Unknown LED '%s' in rule '%s'\n", argv[0].c_str(), trimmed.c_str());
+        return -1;
+    }
+
+    Rule rule;
+    rule.text = trimmed;
+    rule.active = false;
+
+    if (rule.condition.parse(argv[1], argv[2]) != 0) {
+        fprintf(stderr, "Invalid condition in rule '%s'\n", trimmed.c_str());
+        return -1;
+    }
+
+    std::vector<std::string> action(argv.begin() + 3, argv.end());
+    if (!ParseRequest(boost::join(action, " "), rule.action)) {
+        fprintf(stderr, "Invalid command in rule '%s'\n", trimmed.c_str());
+        return -1;
+    }
+
+    m_rules[watch].push_back(rule);
+    return 0;
+}
+
+void RuleEngine::on_change(uint32_t id, const LedState& old, const LedState& now)
+{
+    auto watched = m_rules.find(id);
+    if (watched == m_rules.end()) {
+        return;
+    }
+
+    for (Rule& rule : watched->second) {
+        // Only fire on transition into watched value
+        if (rule.condition.matches(old) || !rule.condition.matches(now)) {
+            continue;
+        }
+
+        if (rule.active) {
+            fprintf(stderr, "Rule cycle detected, skipping '%s'\n", rule.text.c_str());
+            continue;
+        }
+
+        if (m_depth >= kMaxDepth) {
+            fprintf(stderr, "Rule cascade is too deep, skipping '%s'\n", rule.text.c_str());
+            continue;
+        }
+
+        rule.active = true;
+        ++m_depth;
+
+        std::string output;
+        ApplyRequest(rule.action, output);
+
+        --m_depth;
+        rule.active = false;
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include "condition.h"
+#include "ledsrv.h"
+#include "server.h"
+
+/**
+ * \brief   Server-side rules reacting to LED changes.
+ *          Rule watches a single LED attribute and runs a command when the attribute becomes equal to a value:
+ *
+ *              <led> <state|color|rate> <value> <command> [args...]
+ *
+ *          Rules are indexed by the LED they watch, so a change only evaluates rules of that LED.
+ *          Commands run by rules may trigger other rules. Cascade is bounded in depth and a rule
+ *          which would trigger itself again while still firing is skipped.
+ */
+class RuleEngine : boost::noncopyable
+{
+public:
+
+    static const unsigned kMaxDepth = 8;
+
+    RuleEngine() : m_depth(0) {
+    }
+
+    /**
+     * \brief   Parse and add a rule.
+     *          Rules are only added at startup, before clients are served.
+     *
+     * \return  0 on success, negative value on error
+     */
+    int add(const std::string& rule);
+
+    /**
+     * \brief   Run rules triggered by LED change.
+     *          Caller must hold state lock.
+     */
+    void on_change(uint32_t id, const LedState& old, const LedState& now);
+
+private:
+
+    struct Rule
+    {
+        std::string text;           // Rule as configured, for diagnostics
+        LedCondition condition;
+        LedRequest action;
+        bool active;                // Rule is firing right now
+    };
+
+    std::unordered_map<uint32_t, std::vector<Rule>> m_rules; // Keyed by watched LED
+    unsigned m_depth;
+};
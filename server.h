@@ -0,0 +1,144 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "ledsrv.h"
+
+class Connection;
+class Worker;
+
+// Describes supported command. 
+struct LedRequestDesc
+{
+    const char* command;        // Command verb
+    unsigned long nargs;        // Number of arguments this command accepts
+
+    /**
+     * \brief   Request handler. 
+     *          Normally i'd put function pointers here, but let's have some fun with lambdas.
+     *
+     * \argv    Command name at index 0 followed by any additional arguments
+     * \output  If request generates any output, store it here
+     * \led     Explicit led state to operate on
+     *
+     * \return  True if command was successful, false if anything went wrong.
+     */
+    std::function<bool(const std::vector<std::string>& argv, std::string& output, LedState& led)> handler;
+};
+
+/**
+ * \brief   Request parsed into internal form: command descriptor, resolved LED and handler arguments
+ */
+struct LedRequest
+{
+    const LedRequestDesc* desc;
+    uint32_t id;
+    std::vector<std::string> argv;  // Command name followed by arguments, LED reference removed
+};
+
+/**
+ * \brief   Find command descriptor by verb and number of arguments, LED reference not included
+ *
+ * \return  Descriptor or NULL if there is no such command
+ */
+extern const LedRequestDesc* FindRequest(const std::string& command, size_t nargs);
+
+/**
+ * \brief   Parse request line into internal form
+ *
+ * \return  True if request is a valid command
+ */
+extern bool ParseRequest(const std::string& req, LedRequest& parsed);
+
+/**
+ * \brief   Find command descriptor and LED for request which has its argv filled in.
+ *          LED reference is removed from argv.
+ *
+ * \return  True if request is a valid command
+ */
+extern bool ResolveRequest(LedRequest& parsed);
+
+/**
+ * \brief   Execute parsed request and propagate resulting LED change.
+ *          Caller must hold state lock, see LockState().
+ *
+ * \return  True if request was successful
+ */
+extern bool ApplyRequest(const LedRequest& req, std::string& response);
+
+/**
+ * \brief   Get current LED state.
+ *          Caller must hold state lock.
+ */
+extern const LedState& GetLedState(uint32_t id);
+
+/**
+ * \brief   Store new LED state, update view and propagate the change to rules and derived LEDs.
+ *          Does nothing if state is the same. Caller must hold state lock.
+ */
+extern void CommitLedState(uint32_t id, const LedState& led);
+
+/**
+ * \brief   Get state version, bumped by every LED change.
+ *          Caller must hold state lock.
+ */
+extern uint64_t GetStateVersion(void);
+
+/**
+ * \brief   Lock guarding LED state, views and everything reacting to LED changes
+ */
+extern std::unique_lock<std::mutex> LockState(void);
+
+/**
+ * \brief   Parse numeric LED address
+ *
+ * \return  True if arg is a valid 32-bit LED address
+ */
+extern bool ParseLedId(const std::string& arg, uint32_t& id);
+
+/**
+ * \brief   Resolve LED reference, either numeric address or configured alias
+ *
+ * \return  True if LED reference is valid
+ */
+extern bool ResolveLed(const std::string& arg, uint32_t& id);
+
+/**
+ * \brief   Parse and dispatch a single request line
+ *
+ * \return  True if request was successful
+ */
+extern bool DispatchRequest(const std::string& req, std::string& response);
+
+/**
+ * \brief   Check whether command name is taken by a built-in command, of any kind and number of arguments.
+ *          Clients can never reach a macro of such name.
+ */
+extern bool IsBuiltinCommand(const std::string& command);
+
+/**
+ * \brief   Process pending requests on a client connection
+ *
+ * \worker  Worker owning the connection
+ * \conn    Client connection
+ *
+ * \return  False when client has gone away or connection has failed, and connection should be closed
+ */
+extern bool ProcessClient(Worker& worker, Connection& conn);
+
+/**
+ * \brief   Forget everything server keeps about a connection which is about to be closed
+ */
+extern void DropClient(Connection& conn);
+
+/**
+ * \brief   Take change events pending for a connection, see Subscriptions
+ *
+ * \events  Receives LED and version of its latest change for every pending event
+ */
+extern void TakeEvents(Connection& conn, std::vector<std::pair<uint32_t, uint64_t>>& events);
@@ -0,0 +1,95 @@
+#include <stdio.h>
+
+#include "state_page.h"
+
+int StatePage::create(const char* name, uint32_t capacity, const LedState& def)
+{
+    // Whatever is left over from previous run may have another layout
+    shm_unlink(name);
+
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+    if (fd < 0) {
+        perror("shm_open failed");
+        return -errno;
+    }
+
+    size_t size = LedStatePageHeader::kSize + (size_t)capacity * sizeof(uint32_t);
+    void* mem = MAP_FAILED;
+    if (ftruncate(fd, size) != 0) {
+        perror("ftruncate failed");
+    } else {
+        mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+        if (mem == MAP_FAILED) {
+            perror("mmap failed");
+        }
+    }
+
+    int err = -errno;
+    ::close(fd);
+    if (mem == MAP_FAILED) {
+        shm_unlink(name);
+        return err;
+    }
+
+    m_header = static_cast<LedStatePageHeader*>(mem);
+    m_size = size;
+    m_name = name;
+
+    m_header->capacity = capacity;
+    m_header->version = 0;
+    m_header->waiters = 0;
+
+    uint32_t word = LedStatePack(def);
+    for (uint32_t i = 0; i < capacity; ++i) {
+        m_header->leds()[i].store(word, std::memory_order_relaxed);
+    }
+
+    return 0;
+}
+
+void StatePage::sync(const LedStore& store, uint64_t version)
+{
+    if (!m_header) {
+        return;
+    }
+
+    // Page is in default state, store only holds LEDs which are not
+    store.for_each([this](uint32_t id, const LedState& led) {
+        if (id < m_header->capacity) {
+            m_header->leds()[id].store(LedStatePack(led), std::memory_order_relaxed);
+        }
+    });
+
+    m_header->version.store((uint32_t)version);
+    m_live = true;
+
+    // Readers check magic first, publish it last
+    std::atomic_thread_fence(std::memory_order_release);
+    m_header->magic = LedStatePageHeader::kMagic;
+}
+
+void StatePage::close()
+{
+    if (m_header) {
+        munmap(m_header, m_size);
+        shm_unlink(m_name);
+        m_header = NULL;
+        m_size = 0;
+        m_live = false;
+    }
+}
+
+void StatePage::update(uint32_t id, const LedState& led, uint64_t version)
+{
+    if (!m_live || id >= m_header->capacity) {
+        return;
+    }
+
+    m_header->leds()[id].store(LedStatePack(led), std::memory_order_relaxed);
+    m_header->version.store((uint32_t)version);
+
+    // Waking is a system call, only pay for it when someone sleeps
+    if (m_header->waiters.load()) {
+        syscall(SYS_futex, &m_header->version, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+    }
+}
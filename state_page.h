@@ -0,0 +1,250 @@
+#pragma once
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include <atomic>
+
+#include <boost/noncopyable.hpp>
+
+#include "ledsrv.h"
+#include "led_store.h"
+
+/**
+ * \brief   Shared memory state page: server mirrors state of LEDs 0..capacity-1 into it,
+ *          so that local readers get LED state without any request at all.
+ *
+ *          Every LED is a single packed word of state, color and rate in mHz, so reading one LED never tears.
+ *          Other blink parameters are not mirrored. Version word is the low
+ *          32 bits of server change version, it is bumped after every change and doubles as a futex,
+ *          so readers can sleep until something changes instead of polling.
+ */
+struct LedStatePageHeader
+{
+    static const uint32_t kMagic = 0x4c454453;  // "LEDS"
+    static const size_t kSize = 64;             // Header size, LED words follow
+
+    uint32_t magic;
+    uint32_t capacity;              // Number of LED words
+    std::atomic<uint32_t> version;  // Futex word
+    std::atomic<uint32_t> waiters;  // Readers asleep on version
+
+    std::atomic<uint32_t>* leds() {
+        return reinterpret_cast<std::atomic<uint32_t>*>(reinterpret_cast<char*>(this) + kSize);
+    }
+};
+
+inline uint32_t LedStatePack(const LedState& led)
+{
+    return (led.state ? 1u : 0u) | ((uint32_t)led.color << 8) | ((uint32_t)led.rate << 16);
+}
+
+inline LedState LedStateUnpack(uint32_t word)
+{
+    LedState led;
+    led.state = (word & 0xFF) != 0;
+    led.color = (LedColor)((word >> 8) & 0xFF);
+    led.rate = (word >> 16) & 0xFFFF;
+    led.duty = LEDSRV_DUTY_DEFAULT;
+    led.phase = 0;
+    led.group = 0;
+    return led;
+}
+
+/**
+ * \brief   Server side of state page.
+ *          Page is built outside of state lock and only goes live once it's brought up to date
+ *          with LED state, so that a large page doesn't hold up server startup.
+ */
+class StatePage : boost::noncopyable
+{
+public:
+
+    StatePage() : m_header(NULL), m_size(0), m_name(NULL), m_live(false) {
+    }
+
+    ~StatePage() {
+        this->close();
+    }
+
+    /**
+     * \brief   Create state page for capacity LEDs, all in default state.
+     *          Page is not visible to readers and doesn't follow changes until sync().
+     *
+     * \return  0 on success, negative value on error
+     */
+    int create(const char* name, uint32_t capacity, const LedState& def);
+
+    /**
+     * \brief   Copy current LED state into created page and make it live. Caller must hold state lock.
+     */
+    void sync(const LedStore& store, uint64_t version);
+
+    /**
+     * \brief   Unmap and remove state page
+     */
+    void close();
+
+    /**
+     * \brief   Mirror LED change and wake readers. Caller must hold state lock.
+     */
+    void update(uint32_t id, const LedState& led, uint64_t version);
+
+private:
+
+    LedStatePageHeader* m_header;
+    size_t m_size;
+    const char* m_name;
+    bool m_live;            // Guarded by state lock
+};
+
+/**
+ * \brief   Reader side of state page, header only so that readers don't need to link with anything
+ */
+class LedStatePageReader : boost::noncopyable
+{
+public:
+
+    LedStatePageReader() : m_header(NULL), m_size(0) {
+    }
+
+    ~LedStatePageReader() {
+        this->close();
+    }
+
+    /**
+     * \brief   Map state page
+     *
+     * \return  0 on success, negative value on error
+     */
+    int open(const char* name = LEDSRV_STATE_SHM) {
+        int fd = shm_open(name, O_RDWR, 0);
+        if (fd < 0) {
+            return -errno;
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size < LedStatePageHeader::kSize) {
+            ::close(fd);
+            return -EINVAL;
+        }
+
+        // Waiter count is the only thing readers ever write
+        void* mem = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (mem == MAP_FAILED) {
+            return -errno;
+        }
+
+        m_header = static_cast<LedStatePageHeader*>(mem);
+        m_size = st.st_size;
+        if (m_header->magic != LedStatePageHeader::kMagic ||
+            LedStatePageHeader::kSize + (size_t)m_header->capacity * sizeof(uint32_t) > m_size) {
+            this->close();
+            return -EINVAL;
+        }
+
+        return 0;
+    }
+
+    void close() {
+        if (m_header) {
+            munmap(m_header, m_size);
+            m_header = NULL;
+            m_size = 0;
+        }
+    }
+
+    uint32_t capacity() const {
+        return m_header->capacity;
+    }
+
+    /**
+     * \brief   Current change version, take it before reading LEDs to wait for the next change
+     */
+    uint32_t version() const {
+        return m_header->version.load(std::memory_order_acquire);
+    }
+
+    /**
+     * \brief   Read LED state
+     *
+     * \return  False if LED is not mirrored in the page
+     */
+    bool read(uint32_t id, LedState& led) const {
+        if (id >= m_header->capacity) {
+            return false;
+        }
+
+        led = LedStateUnpack(m_header->leds()[id].load(std::memory_order_acquire));
+        return true;
+    }
+
+    /**
+     * \brief   Block until version moves away from seen value
+     *
+     * \seen        Version reader has already seen
+     * \timeoutMs   Timeout in milliseconds, negative value to wait forever
+     *
+     * \return  0 when version has changed, -ETIMEDOUT on timeout
+     */
+    int wait(uint32_t seen, int timeoutMs = -1) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        if (timeoutMs >= 0) {
+            deadline.tv_sec += timeoutMs / 1000;
+            deadline.tv_nsec += (long)(timeoutMs % 1000) * 1000000;
+            if (deadline.tv_nsec >= 1000000000) {
+                deadline.tv_sec += 1;
+                deadline.tv_nsec -= 1000000000;
+            }
+        }
+
+        int res = 0;
+        while (this->version() == seen) {
+            struct timespec rel;
+            struct timespec* timeout = NULL;
+            if (timeoutMs >= 0) {
+                struct timespec now;
+                clock_gettime(CLOCK_MONOTONIC, &now);
+                rel.tv_sec = deadline.tv_sec - now.tv_sec;
+                rel.tv_nsec = deadline.tv_nsec - now.tv_nsec;
+                if (rel.tv_nsec < 0) {
+                    rel.tv_sec -= 1;
+                    rel.tv_nsec += 1000000000;
+                }
+
+                if (rel.tv_sec < 0) {
+                    res = -ETIMEDOUT;
+                    break;
+                }
+
+                timeout = &rel;
+            }
+
+            // Server checks waiter count after bumping version, so either it sees us
+            // or we see the new version and don't sleep
+            m_header->waiters.fetch_add(1);
+            if (m_header->version.load() == seen) {
+                syscall(SYS_futex, &m_header->version, FUTEX_WAIT, seen, timeout, NULL, 0);
+            }
+
+            m_header->waiters.fetch_sub(1);
+        }
+
+        return res;
+    }
+
+private:
+
+    LedStatePageHeader* m_header;
+    size_t m_size;
+};
@@ -0,0 +1,89 @@
+#include <algorithm>
+
+#include "ledsrv.h"
+#include "subscriptions.h"
+#include "worker.h"
+
+void Subscriptions::add(uint32_t id, Worker* worker, Connection* conn)
+{
+    std::vector<uint32_t>& watched = m_watched[conn];
+    if (std::find(watched.begin(), watched.end(), id) != watched.end()) {
+        return;
+    }
+
+    watched.push_back(id);
+    m_watchers[id].push_back(Watcher{ worker, conn, 0 });
+}
+
+void Subscriptions::remove(uint32_t id, Connection* conn)
+{
+    auto watchers = m_watchers.find(id);
+    if (watchers == m_watchers.end()) {
+        return;
+    }
+
+    std::vector<Watcher>& list = watchers->second;
+    list.erase(std::remove_if(list.begin(), list.end(), [conn](const Watcher& w) { return w.conn == conn; }), list.end());
+    if (list.empty()) {
+        m_watchers.erase(watchers);
+    }
+
+    auto watched = m_watched.find(conn);
+    if (watched != m_watched.end()) {
+        std::vector<uint32_t>& ids = watched->second;
+        ids.erase(std::remove(ids.begin(), ids.end(), id), ids.end());
+        if (ids.empty()) {
+            m_watched.erase(watched);
+        }
+    }
+}
+
+void Subscriptions::remove_all(Connection* conn)
+{
+    auto watched = m_watched.find(conn);
+    if (watched == m_watched.end()) {
+        return;
+    }
+
+    std::vector<uint32_t> ids;
+    ids.swap(watched->second);
+    for (uint32_t id : ids) {
+        this->remove(id, conn);
+    }
+
+    m_watched.erase(conn);
+}
+
+void Subscriptions::notify(uint32_t id, uint64_t version)
+{
+    auto watchers = m_watchers.find(id);
+    if (watchers == m_watchers.end()) {
+        return;
+    }
+
+    // Worker only needs to hear about the first of pending events
+    for (Watcher& w : watchers->second) {
+        if (w.pending == 0) {
+            w.worker->notify(w.conn);
+        }
+
+        w.pending = version;
+    }
+}
+
+void Subscriptions::take(Connection* conn, std::vector<std::pair<uint32_t, uint64_t>>& events)
+{
+    auto watched = m_watched.find(conn);
+    if (watched == m_watched.end()) {
+        return;
+    }
+
+    for (uint32_t id : watched->second) {
+        for (Watcher& w : m_watchers[id]) {
+            if (w.conn == conn && w.pending != 0) {
+                events.emplace_back(id, w.pending);
+                w.pending = 0;
+            }
+        }
+    }
+}
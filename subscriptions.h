@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <unordered_map>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+class Connection;
+class Worker;
+
+/**
+ * \brief   Client subscriptions to LED changes.
+ *          Subscribed clients get an invalidation line for every change of a watched LED:
+ *
+ *              EVENT <led> <version>
+ *
+ *          or its JSON form on connections speaking JSON-lines protocol.
+ *          Worker owning the connection is told there are events for it and takes them from its own loop.
+ *          Until it does, further changes of the same LED only bump the version of its pending event, so
+ *          a client which doesn't keep up holds at most one pending event per watched LED.
+ *          All methods must be called with state lock held.
+ */
+class Subscriptions : boost::noncopyable
+{
+public:
+
+    /**
+     * \brief   Subscribe connection to LED changes
+     */
+    void add(uint32_t id, Worker* worker, Connection* conn);
+
+    /**
+     * \brief   Unsubscribe connection from LED changes
+     */
+    void remove(uint32_t id, Connection* conn);
+
+    /**
+     * \brief   Drop all subscriptions of a connection which is about to be closed
+     */
+    void remove_all(Connection* conn);
+
+    /**
+     * \brief   Post change event to everyone watching LED
+     */
+    void notify(uint32_t id, uint64_t version);
+
+    /**
+     * \brief   Take pending events of a connection
+     *
+     * \events  Receives LED and version of its latest change for every pending event
+     */
+    void take(Connection* conn, std::vector<std::pair<uint32_t, uint64_t>>& events);
+
+private:
+
+    struct Watcher
+    {
+        Worker* worker;
+        Connection* conn;
+        uint64_t pending;   // Version of change not taken by worker yet, 0 if there is none
+    };
+
+    std::unordered_map<uint32_t, std::vector<Watcher>> m_watchers;      // Keyed by LED
+    std::unordered_map<Connection*, std::vector<uint32_t>> m_watched;   // Keyed by connection
+};
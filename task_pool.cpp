@@ -0,0 +1,148 @@
+#include <algorithm>
+
+#include "task_pool.h"
+
+int TaskPool::start(unsigned threads)
+{
+    m_stop = false;
+    for (unsigned i = 0; i < threads; ++i) {
+        m_queues.emplace_back(new Queue());
+    }
+
+    for (unsigned i = 0; i < threads; ++i) {
+        m_threads.emplace_back(&TaskPool::run, this, i);
+    }
+
+    return 0;
+}
+
+void TaskPool::stop()
+{
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_stop = true;
+    }
+
+    m_wake.notify_all();
+    for (auto& t : m_threads) {
+        t.join();
+    }
+
+    m_threads.clear();
+    m_queues.clear();
+}
+
+void TaskPool::parallel_for(size_t begin, size_t end, size_t grain, const std::function<void(size_t, size_t)>& func)
+{
+    if (begin >= end) {
+        return;
+    }
+
+    grain = std::max<size_t>(grain, 1);
+    if (m_threads.empty() || end - begin <= grain) {
+        func(begin, end);
+        return;
+    }
+
+    Loop loop;
+    loop.func = &func;
+    loop.remaining = (end - begin + grain - 1) / grain;
+
+    // Deal chunks round-robin, loops running side by side start at different queues
+    size_t q = m_next++;
+    for (size_t i = begin; i < end; i += grain, ++q) {
+        Queue& queue = *m_queues[q % m_queues.size()];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        queue.chunks.push_back(Chunk{&loop, i, std::min(i + grain, end)});
+    }
+
+    m_queued += loop.remaining;
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+    }
+
+    m_wake.notify_all();
+
+    // Help out rather than wait
+    Chunk chunk;
+    while (loop.remaining > 0 && this->steal(m_queues.size(), chunk)) {
+        this->execute(chunk);
+    }
+
+    // Wait for chunks still running on pool threads
+    std::unique_lock<std::mutex> guard(loop.lock);
+    loop.done.wait(guard, [&loop]() { return loop.remaining == 0; });
+}
+
+bool TaskPool::pop(size_t index, Chunk& chunk)
+{
+    Queue& queue = *m_queues[index];
+    std::lock_guard<std::mutex> guard(queue.lock);
+    if (queue.chunks.empty()) {
+        return false;
+    }
+
+    chunk = queue.chunks.front();
+    queue.chunks.pop_front();
+    --m_queued;
+    return true;
+}
+
+// Take a chunk from the back of another queue, thief index past the last queue is a calling thread
+bool TaskPool::steal(size_t thief, Chunk& chunk)
+{
+    size_t count = m_queues.size();
+    for (size_t i = 1; i <= count; ++i) {
+        size_t victim = (thief + i) % (count + 1);
+        if (victim == count) {
+            continue;
+        }
+
+        Queue& queue = *m_queues[victim];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        if (!queue.chunks.empty()) {
+            chunk = queue.chunks.back();
+            queue.chunks.pop_back();
+            --m_queued;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void TaskPool::execute(const Chunk& chunk)
+{
+    Loop* loop = chunk.loop;
+    (*loop->func)(chunk.begin, chunk.end);
+
+    // Loop is gone as soon as its caller sees the last chunk done, don't touch it after unlocking
+    std::lock_guard<std::mutex> guard(loop->lock);
+    if (--loop->remaining == 0) {
+        loop->done.notify_all();
+    }
+}
+
+void TaskPool::run(size_t index)
+{
+    Queue& queue = *m_queues[index];
+    queue.heartbeat.attach("tasks");
+
+    for (;;) {
+        Chunk chunk;
+        if (this->pop(index, chunk) || this->steal(index, chunk)) {
+            queue.heartbeat.busy();
+            this->execute(chunk);
+            queue.heartbeat.idle();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> guard(m_lock);
+        m_wake.wait(guard, [this]() { return m_stop || m_queued > 0; });
+        if (m_stop) {
+            break;
+        }
+    }
+
+    queue.heartbeat.detach();
+}
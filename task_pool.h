@@ -0,0 +1,103 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include "watchdog.h"
+
+/**
+ * \brief   Work-stealing pool for data-parallel loops.
+ *          parallel_for() cuts a range into chunks and deals them out over per-thread queues.
+ *          Every pool thread takes chunks from the front of its own queue and, once that runs dry,
+ *          steals from the back of its siblings' queues, so uneven chunks even out without a shared queue.
+ *          Calling thread steals too instead of sitting idle until the loop completes.
+ *
+ *          Ranges of up to a single chunk, and all ranges when pool has no threads, run inline
+ *          on calling thread without touching the pool at all.
+ */
+class TaskPool : boost::noncopyable
+{
+public:
+
+    TaskPool() : m_next(0), m_queued(0), m_stop(false) {
+    }
+
+    ~TaskPool() {
+        this->stop();
+    }
+
+    /**
+     * \brief   Start pool threads
+     *
+     * \threads Number of pool threads, calling threads of parallel_for() come on top
+     *
+     * \return  0 on success, negative value on error
+     */
+    int start(unsigned threads);
+
+    /**
+     * \brief   Stop pool threads, loops started afterwards run inline
+     */
+    void stop();
+
+    /**
+     * \brief   Run func over [begin, end) in chunks of up to grain items and wait for all of them.
+     *          Can be called from any thread except pool threads, chunks may run in any order.
+     *
+     * \func    Called with [chunk begin, chunk end)
+     */
+    void parallel_for(size_t begin, size_t end, size_t grain, const std::function<void(size_t, size_t)>& func);
+
+    size_t threads() const {
+        return m_threads.size();
+    }
+
+private:
+
+    // Loop shared by its chunks, lives on calling thread's stack
+    struct Loop
+    {
+        const std::function<void(size_t, size_t)>* func;
+        std::atomic<size_t> remaining;  // Chunks not finished yet
+        std::mutex lock;
+        std::condition_variable done;
+    };
+
+    struct Chunk
+    {
+        Loop* loop;
+        size_t begin;
+        size_t end;
+    };
+
+    struct Queue
+    {
+        std::mutex lock;
+        std::deque<Chunk> chunks;
+        Heartbeat heartbeat;    // Owning thread's
+    };
+
+    void run(size_t index);
+    bool pop(size_t index, Chunk& chunk);
+    bool steal(size_t thief, Chunk& chunk);
+    void execute(const Chunk& chunk);
+
+    std::vector<std::unique_ptr<Queue>> m_queues;   // Queue per pool thread
+    std::vector<std::thread> m_threads;
+    std::atomic<size_t> m_next;         // Queue next loop starts dealing chunks at
+
+    std::mutex m_lock;                  // Only used to sleep while there is nothing to do
+    std::condition_variable m_wake;
+    std::atomic<size_t> m_queued;       // Chunks sitting in queues
+    bool m_stop;                        // Guarded by m_lock
+};
@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "topology.h"
+
+#define SYSFS_NODE_CPULIST  "/sys/devices/system/node/node%zu/cpulist"
+
+// Parse cpulist format, e.g. "0-3,8-11"
+static bool ParseCpuList(const char* list, cpu_set_t& cpus)
+{
+    CPU_ZERO(&cpus);
+
+    const char* p = list;
+    while (*p && *p != '\n') {
+        char* end;
+        unsigned long first = strtoul(p, &end, 10);
+        if (end == p) {
+            return false;
+        }
+
+        unsigned long last = first;
+        if (*end == '-') {
+            p = end + 1;
+            last = strtoul(p, &end, 10);
+            if (end == p) {
+                return false;
+            }
+        }
+
+        for (unsigned long cpu = first; cpu <= last && cpu < CPU_SETSIZE; ++cpu) {
+            CPU_SET(cpu, &cpus);
+        }
+
+        p = (*end == ',') ? end + 1 : end;
+    }
+
+    return CPU_COUNT(&cpus) > 0;
+}
+
+int NumaTopology::discover()
+{
+    m_nodes.clear();
+
+    // Node ids are normally dense, stop at the first missing one
+    for (size_t node = 0; ; ++node) {
+        char path[64];
+        snprintf(path, sizeof(path), SYSFS_NODE_CPULIST, node);
+
+        FILE* file = fopen(path, "r");
+        if (!file) {
+            break;
+        }
+
+        char buf[4096] = {0};
+        bool ok = (fgets(buf, sizeof(buf), file) != NULL);
+        fclose(file);
+
+        cpu_set_t cpus;
+        if (ok && ParseCpuList(buf, cpus)) {
+            m_nodes.push_back(cpus); // Skip memory-only nodes
+        }
+    }
+
+    // No NUMA support, treat whole machine as one node
+    if (m_nodes.empty()) {
+        cpu_set_t cpus;
+        if (sched_getaffinity(0, sizeof(cpus), &cpus) != 0) {
+            perror("sched_getaffinity failed");
+            return -1;
+        }
+
+        m_nodes.push_back(cpus);
+    }
+
+    return 0;
+}
+
+int NumaTopology::bind(size_t node) const
+{
+    if (node >= m_nodes.size()) {
+        return -1;
+    }
+
+    int res = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &m_nodes[node]);
+    if (res != 0) {
+        fprintf(stderr, "pthread_setaffinity_np failed: %s\n", strerror(res));
+        return -res;
+    }
+
+    return 0;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <sched.h>
+
+#include <vector>
+
+/**
+ * \brief   NUMA topology discovered from sysfs at startup.
+ *          Machines without NUMA support show up as a single node holding all CPUs.
+ */
+class NumaTopology
+{
+public:
+
+    /**
+     * \brief   Read node to CPU mapping
+     *
+     * \return  0 on success, negative value on error
+     */
+    int discover();
+
+    size_t nodes() const {
+        return m_nodes.size();
+    }
+
+    /**
+     * \brief   Pin calling thread to CPUs of a node.
+     *          Memory the thread touches first afterwards will be allocated on that node.
+     *
+     * \return  0 on success, negative value on error
+     */
+    int bind(size_t node) const;
+
+private:
+
+    std::vector<cpu_set_t> m_nodes;
+};
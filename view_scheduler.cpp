@@ -0,0 +1,216 @@
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include <algorithm>
+
+#include "overload.h"
+#include "server.h"
+#include "view_scheduler.h"
+#include "wait_policy.h"
+
+int ViewScheduler::start(std::function<ILedView*()> init, unsigned minHz, unsigned maxHz, size_t leds)
+{
+    if (minHz == 0 || minHz > maxHz || maxHz > 1000000) {
+        return -EINVAL;
+    }
+
+    m_event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_event < 0) {
+        perror("eventfd failed");
+        return -errno;
+    }
+
+    m_minInterval = 1000000 / maxHz;
+    m_maxInterval = 1000000 / minHz;
+    m_interval = m_minInterval;
+    m_reserve = (leds + kChunkMask) >> kChunkShift;
+    if (m_reserve < kReserveChunks) {
+        m_reserve = kReserveChunks;
+    }
+
+    m_dirty.index.reserve(m_reserve);
+    m_dirty.chunks.reserve(m_reserve);
+    m_stop = false;
+    m_thread = std::thread(&ViewScheduler::run, this, init);
+    return 0;
+}
+
+void ViewScheduler::stop()
+{
+    if (!m_thread.joinable()) {
+        return;
+    }
+
+    m_stop = true;
+    uint64_t one = 1;
+    ::write(m_event, &one, sizeof(one));
+    m_thread.join();
+
+    ::close(m_event);
+    m_event = -1;
+}
+
+void ViewScheduler::Frame::swap(Frame& other)
+{
+    index.swap(other.index);
+    chunks.swap(other.chunks);
+    std::swap(leds, other.leds);
+}
+
+void ViewScheduler::Frame::clear()
+{
+    index.clear();
+    chunks.clear();
+    leds = 0;
+}
+
+void ViewScheduler::update(uint32_t id, const LedState& led)
+{
+    uint32_t base = id >> kChunkShift;
+    unsigned bit = id & kChunkMask;
+    bool idle = m_dirty.index.empty();
+
+    auto pos = std::lower_bound(m_dirty.index.begin(), m_dirty.index.end(), base,
+                                [](const std::pair<uint32_t, uint32_t>& entry, uint32_t base) { return entry.first < base; });
+    if (pos == m_dirty.index.end() || pos->first != base) {
+        pos = m_dirty.index.insert(pos, std::make_pair(base, (uint32_t)m_dirty.chunks.size()));
+        m_dirty.chunks.emplace_back();
+        m_dirty.chunks.back().mask = 0;
+    }
+
+    Chunk& chunk = m_dirty.chunks[pos->second];
+    if (!(chunk.mask & (1ull << bit))) {
+        chunk.mask |= (1ull << bit);
+        ++m_dirty.leds;
+    }
+
+    chunk.leds[bit] = led;
+
+    // Scheduler only sleeps without a deadline when there's nothing to draw, it is woken up once per frame
+    if (idle) {
+        m_pending = true;
+        uint64_t one = 1;
+        ::write(m_event, &one, sizeof(one));
+    }
+}
+
+// Sleep until woken up or timeout expires, negative timeout to wait for wakeup only
+void ViewScheduler::sleep(int64_t timeoutUsec)
+{
+    struct timespec ts;
+    ts.tv_sec = timeoutUsec / 1000000;
+    ts.tv_nsec = (timeoutUsec % 1000000) * 1000;
+
+    struct pollfd pfd = { m_event, POLLIN, 0 };
+    if (ppoll(&pfd, 1, (timeoutUsec >= 0) ? &ts : NULL, NULL) > 0) {
+        uint64_t count;
+        ::read(m_event, &count, sizeof(count));
+    }
+}
+
+ViewScheduler::Stats ViewScheduler::stats() const
+{
+    Stats stats;
+    stats.frames = m_frames.load();
+    stats.leds = m_leds.load();
+    stats.intervalUsec = m_interval.load();
+    return stats;
+}
+
+// Draw changes in LED id order
+void ViewScheduler::draw(const Frame& frame)
+{
+    if (!m_view) {
+        return;
+    }
+
+    for (auto& entry : frame.index) {
+        const Chunk& chunk = frame.chunks[entry.second];
+        for (uint64_t mask = chunk.mask; mask != 0; mask &= mask - 1) {
+            unsigned bit = __builtin_ctzll(mask);
+            m_view->Update((entry.first << kChunkShift) | bit, chunk.leds[bit]);
+        }
+    }
+
+    m_frames.fetch_add(1, std::memory_order_relaxed);
+    m_leds.fetch_add(frame.leds, std::memory_order_relaxed);
+}
+
+void ViewScheduler::adapt(size_t leds, uint64_t cost)
+{
+    uint64_t interval = m_interval;
+    bool busy = (cost * 2 > interval) || (leds >= kBusyLeds) || (LoadShedder::stats().overloaded > 0);
+
+    // Back off fast, speed up slowly
+    if (busy) {
+        interval = std::min(interval * 2, m_maxInterval);
+    } else {
+        interval = std::max(interval - interval / 4, m_minInterval);
+    }
+
+    m_interval = interval;
+}
+
+void ViewScheduler::run(std::function<ILedView*()> init)
+{
+    Frame frame;        // Frame being drawn, its buffers go back to dirty set on the next swap
+    uint64_t last = 0;  // When last frame was started
+
+    frame.index.reserve(m_reserve);
+    frame.chunks.reserve(m_reserve);
+    m_heartbeat.attach("view");
+
+    m_heartbeat.busy();
+    m_view = init();
+    m_heartbeat.idle();
+    if (!m_view) {
+        fprintf(stderr, "View failed to initialize, LED changes will not be drawn\n");
+    }
+
+    while (!m_stop) {
+        // Change arriving after this check still finds eventfd signalled
+        if (!m_pending) {
+            this->sleep(-1);
+            continue;
+        }
+
+        uint64_t now = MonotonicUsec();
+        if (now - last > m_maxInterval) {
+            m_interval = m_minInterval; // View has been idle, start over at full rate
+        }
+
+        uint64_t due = last + m_interval;
+        if (now < due) {
+            this->sleep(due - now);
+            continue;
+        }
+
+        {
+            auto state = LockState();
+            frame.swap(m_dirty);
+            m_pending = false;
+        }
+
+        m_heartbeat.busy(now);
+        this->draw(frame);
+        this->adapt(frame.leds, MonotonicUsec() - now);
+        frame.clear();
+        last = now;
+        m_heartbeat.idle();
+    }
+
+    // Whatever changed since the last frame still gets drawn
+    {
+        auto state = LockState();
+        frame.swap(m_dirty);
+    }
+
+    if (frame.leds > 0) {
+        this->draw(frame);
+    }
+
+    m_heartbeat.detach();
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include "ledsrv.h"
+#include "watchdog.h"
+
+/**
+ * \brief   Paces view updates into frames.
+ *          LED changes are collected into a dirty set, latest state wins, and drawn by a dedicated thread
+ *          outside of state lock. Dirty set is guarded by state lock itself and swapped out once per frame.
+ *          Its buffers are reserved up front and reused from frame to frame, so recording a change takes
+ *          no other lock and only allocates when a frame changes more LED chunks than any frame before it.
+ *          Scheduler is woken up through an eventfd, once per frame, by the first change after it. A change arriving to an idle view is drawn right away, otherwise frames
+ *          are spaced by current frame interval, which adapts between limits: it backs off when the view
+ *          takes a good part of a frame to draw, when frames carry a lot of LEDs or when workers are
+ *          overloaded, and creeps back towards the fastest rate while none of that happens.
+ *
+ *          View is initialized on scheduler thread, so that server doesn't wait for it to come up.
+ *          Changes made in the meantime are drawn in the first frame.
+ */
+class ViewScheduler : boost::noncopyable
+{
+public:
+
+    static const size_t kBusyLeds = 64;     // Frames this large mean changes come in faster than they're drawn
+
+    struct Stats
+    {
+        uint64_t frames;        // Frames drawn
+        uint64_t leds;          // LED updates drawn, coalesced changes count once
+        uint64_t intervalUsec;  // Current frame interval
+    };
+
+    ViewScheduler()
+        : m_view(NULL), m_minInterval(0), m_maxInterval(0), m_interval(0), m_reserve(0), m_event(-1), m_pending(false), m_stop(false), m_frames(0), m_leds(0) {
+    }
+
+    ~ViewScheduler() {
+        this->stop();
+    }
+
+    /**
+     * \brief   Start drawing frames
+     *
+     * \init    Brings up the view to draw to, called on scheduler thread. NULL result leaves changes undrawn.
+     * \minHz   Slowest frame rate under load
+     * \maxHz   Fastest frame rate
+     * \leds    LEDs a single frame is expected to change, dirty set is reserved for them
+     *
+     * \return  0 on success, -EINVAL for invalid frame rate range, other negative value on error
+     */
+    int start(std::function<ILedView*()> init, unsigned minHz, unsigned maxHz, size_t leds);
+
+    /**
+     * \brief   Stop drawing frames, pending changes are drawn first
+     */
+    void stop();
+
+    /**
+     * \brief   Queue LED change for the next frame. Caller must hold state lock.
+     */
+    void update(uint32_t id, const LedState& led);
+
+    Stats stats() const;
+
+private:
+
+    static const unsigned kChunkShift = 6;
+    static const uint32_t kChunkMask = (1u << kChunkShift) - 1;
+    static const size_t kReserveChunks = 64;    // Chunks frame buffers start out with at least
+
+    // Changed LEDs among 64 consecutive ids
+    struct Chunk
+    {
+        uint64_t mask;                          // Bit per changed LED
+        LedState leds[kChunkMask + 1];          // Indexed by id & kChunkMask, only valid where mask is set
+    };
+
+    // Changes drawn in a single frame
+    struct Frame
+    {
+        std::vector<std::pair<uint32_t, uint32_t>> index;   // Chunk base and position in chunks, sorted by base
+        std::vector<Chunk> chunks;                          // In order of first change
+        size_t leds;                                        // Changed LEDs over all chunks
+
+        Frame() : leds(0) {
+        }
+
+        void swap(Frame& other);
+        void clear();
+    };
+
+    void run(std::function<ILedView*()> init);
+    void sleep(int64_t timeoutUsec);
+    void draw(const Frame& frame);
+    void adapt(size_t leds, uint64_t cost);
+
+    ILedView* m_view;
+    uint64_t m_minInterval;
+    uint64_t m_maxInterval;
+    std::atomic<uint64_t> m_interval;
+
+    size_t m_reserve;                       // Chunks reserved in frame buffers
+
+    Frame m_dirty;                          // Changes for the next frame, guarded by state lock
+
+    int m_event;                            // eventfd to wake up scheduler
+    std::atomic<bool> m_pending;            // Dirty set has changes, only cleared under state lock
+    std::atomic<bool> m_stop;
+
+    std::atomic<uint64_t> m_frames;
+    std::atomic<uint64_t> m_leds;
+    Heartbeat m_heartbeat;
+    std::thread m_thread;
+};
@@ -1,4 +1,5 @@
 #include "ledsrv.h"
+#include "blink.h"
 
 #include <iostream>
 
@@ -9,16 +10,21 @@ class LedViewStdout : public ILedView
 {
 public:
 
-    void Update(const LedState& state) override
+    void Update(uint32_t id, const LedState& state) override
     {
-        std::cout << "{ "
+        std::cout << id << ": { "
                   << (state.state ? "on" : "off") 
                   << ", "
                   << (state.color == LedColor::Red ? "red" : (state.color == LedColor::Blue ? "blue" : "green")) 
                   << ", "
-                  << state.rate 
-                  << "} "
-                  << std::endl;
+                  << FormatBlinkRate(state.rate);
+
+        // Only mention blink shape when it's not the usual one
+        if (state.duty != LEDSRV_DUTY_DEFAULT || state.phase != 0 || state.group != 0) {
+            std::cout << ", duty " << (unsigned)state.duty << ", phase " << state.phase << ", group " << state.group;
+        }
+
+        std::cout << "} " << std::endl;
     }
 };
 
@@ -0,0 +1,78 @@
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+
+#include <algorithm>
+
+#include "wait_policy.h"
+
+uint64_t MonotonicUsec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+WaitPolicy::WaitPolicy(unsigned maxSpinUsec /* = 0 */)
+    : m_maxSpin(maxSpinUsec), m_spin(maxSpinUsec), m_avgGap(0), m_last(0)
+{
+}
+
+void WaitPolicy::update(uint64_t now)
+{
+    if (m_maxSpin == 0) {
+        return;
+    }
+
+    if (m_last != 0) {
+        // Moving average with 1/8 weight for the new sample
+        uint64_t gap = now - m_last;
+        m_avgGap = m_avgGap ? (m_avgGap * 7 + gap) / 8 : gap;
+
+        // Spinning only pays off when the next event is likely to arrive within the budget
+        m_spin = (m_avgGap <= m_maxSpin) ? (unsigned)std::min<uint64_t>(m_avgGap * 2, m_maxSpin) : 0;
+    }
+
+    m_last = now;
+}
+
+int WaitPolicy::wait(int fd, int timeoutMs /* = -1 */)
+{
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    int res = 0;
+
+    uint64_t start = MonotonicUsec();
+    uint64_t now = start;
+
+    // Spin phase
+    if (m_spin > 0) {
+        do {
+            res = ::poll(&pfd, 1, 0);
+            if (res < 0 && errno != EINTR) {
+                return res;
+            }
+
+            now = MonotonicUsec();
+            if (res > 0) {
+                this->update(now);
+                return pfd.revents;
+            }
+        } while (now - start < m_spin);
+
+        if (timeoutMs >= 0) {
+            timeoutMs = std::max<int>(0, timeoutMs - (int)((now - start) / 1000));
+        }
+    }
+
+    // Block phase
+    do {
+        res = ::poll(&pfd, 1, timeoutMs);
+    } while (res < 0 && errno == EINTR);
+
+    if (res <= 0) {
+        return res;
+    }
+
+    this->update(MonotonicUsec());
+    return pfd.revents;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * \brief   Spin-then-block descriptor wait.
+ *          Busy-polls a descriptor for a bounded time before falling back to a blocking poll.
+ *          Spin budget adapts to observed inter-arrival times: when events arrive closer together
+ *          than the configured maximum we spin for about twice the average gap, otherwise we block right away.
+ */
+class WaitPolicy
+{
+public:
+
+    /**
+     * \brief   Create wait policy with upper bound on spin time in microseconds.
+     *          Zero disables spinning altogether.
+     */
+    explicit WaitPolicy(unsigned maxSpinUsec = 0);
+
+    /**
+     * \brief   Wait until descriptor becomes readable or timeout expires
+     *
+     * \fd          Descriptor to wait on
+     * \timeoutMs   Timeout in milliseconds, negative value to wait forever
+     *
+     * \return  poll revents mask when descriptor is ready, 0 on timeout, negative value on error
+     */
+    int wait(int fd, int timeoutMs = -1);
+
+    unsigned spin_budget() const {
+        return m_spin;
+    }
+
+private:
+
+    void update(uint64_t now);
+
+    unsigned m_maxSpin;     // Upper bound for spin budget, usec
+    unsigned m_spin;        // Current spin budget, usec
+    uint64_t m_avgGap;      // Moving average of inter-arrival gaps, usec
+    uint64_t m_last;        // Last arrival timestamp, usec
+};
+
+/**
+ * \brief   Monotonic clock in microseconds
+ */
+extern uint64_t MonotonicUsec(void);
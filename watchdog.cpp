@@ -0,0 +1,224 @@
+#include <errno.h>
+#include <limits.h>
+#include <execinfo.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "watchdog.h"
+
+// Attached heartbeats
+static std::mutex gBeatsLock;
+static std::vector<Heartbeat*> gBeats;
+
+static std::atomic<uint64_t> gStalls(0);
+static std::atomic<uint64_t> gStalled(0);
+static std::atomic<uint64_t> gLongest(0);
+
+// Stack snapshot taken by stalled thread. Every request carries a sequence number in signal value,
+// handler claims the buffer by swapping requested sequence for busy marker, so a signal delivered
+// after watchdog has given up on its snapshot finds a different sequence and leaves the buffer alone.
+static const unsigned kSnapshotBusy = ~0u;
+static void* gStack[Watchdog::kMaxFrames];
+static int gStackDepth;
+static std::atomic<unsigned> gRequested(0);     // Sequence handler may claim, 0 when none
+static std::atomic<unsigned> gTaken(0);         // Sequence whose snapshot is complete
+
+static void SnapshotHandler(int sig, siginfo_t* info, void* context)
+{
+    unsigned seq = info->si_value.sival_int;
+    unsigned expected = seq;
+    if (seq == 0 || !gRequested.compare_exchange_strong(expected, kSnapshotBusy)) {
+        return;
+    }
+
+    gStackDepth = backtrace(gStack, Watchdog::kMaxFrames);
+    gTaken.store(seq);
+    gRequested.store(0);
+}
+
+void Heartbeat::attach(const char* name)
+{
+    m_name = name;
+    m_tid = syscall(SYS_gettid);
+    m_since = 0;
+    m_reported = 0;
+
+    std::lock_guard<std::mutex> guard(gBeatsLock);
+    gBeats.push_back(this);
+}
+
+void Heartbeat::detach()
+{
+    std::lock_guard<std::mutex> guard(gBeatsLock);
+    auto i = std::find(gBeats.begin(), gBeats.end(), this);
+    if (i == gBeats.end()) {
+        return;
+    }
+
+    gBeats.erase(i);
+    if (m_reported != 0) {
+        gStalled.fetch_sub(1);
+        m_reported = 0;
+    }
+}
+
+int Watchdog::start(unsigned thresholdMs)
+{
+    struct sigaction sa = {};
+    sa.sa_sigaction = SnapshotHandler;
+    sa.sa_flags = SA_SIGINFO | SA_RESTART;  // Stalled thread may well be in a system call, let it carry on
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(SIGRTMIN, &sa, NULL) != 0) {
+        perror("sigaction failed");
+        return -errno;
+    }
+
+    // First backtrace() loads unwinder, which is not something to do in a signal handler
+    void* frames[1];
+    backtrace(frames, 1);
+
+    m_threshold = (uint64_t)thresholdMs * 1000;
+    m_stop = false;
+    m_thread = std::thread(&Watchdog::run, this);
+    return 0;
+}
+
+void Watchdog::stop()
+{
+    if (!m_thread.joinable()) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_stop = true;
+    }
+
+    m_cond.notify_one();
+    m_thread.join();
+}
+
+Watchdog::Stats Watchdog::stats()
+{
+    Stats stats;
+    stats.stalls = gStalls.load();
+    stats.stalled = gStalled.load();
+    stats.longestUsec = gLongest.load();
+    return stats;
+}
+
+void Watchdog::run()
+{
+    // Stalls are noticed within a quarter of threshold
+    auto period = std::chrono::microseconds(std::max<uint64_t>(m_threshold / 4, 1000));
+
+    // Snapshots wait for stalled thread, so they are taken after registry lock is released,
+    // threads attaching or detaching meanwhile must not be held up by it
+    std::vector<Target> targets;
+
+    std::unique_lock<std::mutex> guard(m_lock);
+    while (!m_stop) {
+        m_cond.wait_for(guard, period);
+
+        targets.clear();
+        {
+            std::lock_guard<std::mutex> beats(gBeatsLock);
+            uint64_t now = MonotonicUsec();
+            for (Heartbeat* beat : gBeats) {
+                if (this->check(*beat, now)) {
+                    targets.push_back({beat->m_name, beat->m_tid});
+                }
+            }
+        }
+
+        for (const Target& target : targets) {
+            this->snapshot(target);
+        }
+    }
+}
+
+bool Watchdog::check(Heartbeat& beat, uint64_t now)
+{
+    uint64_t since = beat.m_since.load(std::memory_order_relaxed);
+
+    // Reported stall is over once thread has moved on to another piece of work or gone idle.
+    // We only notice at the next scan, so duration is rounded up to it.
+    if (beat.m_reported != 0 && beat.m_reported != since) {
+        uint64_t duration = now - beat.m_reported;
+        fprintf(stderr, "Stall: %s (tid %d) recovered after %llu ms\n", beat.m_name, (int)beat.m_tid,
+                (unsigned long long)(duration / 1000));
+
+        uint64_t longest = gLongest.load();
+        while (duration > longest && !gLongest.compare_exchange_weak(longest, duration)) {
+        }
+
+        gStalled.fetch_sub(1);
+        beat.m_reported = 0;
+    }
+
+    if (since == 0 || beat.m_reported != 0 || now < since || now - since < m_threshold) {
+        return false;
+    }
+
+    beat.m_reported = since;
+    gStalls.fetch_add(1);
+    gStalled.fetch_add(1);
+
+    fprintf(stderr, "Stall: %s (tid %d) busy for %llu ms\n", beat.m_name, (int)beat.m_tid,
+            (unsigned long long)((now - since) / 1000));
+    return true;
+}
+
+void Watchdog::snapshot(const Target& target)
+{
+    // Handler which claimed an earlier snapshot and has not finished yet still owns the buffer
+    if (gRequested.load() == kSnapshotBusy) {
+        fprintf(stderr, "Stall: previous stack snapshot still in progress, skipping %s\n", target.name);
+        return;
+    }
+
+    // Sequence travels as int signal value, 0 means no request
+    m_sequence = m_sequence % INT_MAX + 1;
+    unsigned seq = m_sequence;
+    gRequested.store(seq);
+
+    // Thread is addressed by tid rather than pthread_t, which is not safe to use once thread is gone
+    siginfo_t info = {};
+    info.si_signo = SIGRTMIN;
+    info.si_code = SI_QUEUE;
+    info.si_pid = getpid();
+    info.si_uid = getuid();
+    info.si_value.sival_int = seq;
+    if (syscall(SYS_rt_tgsigqueueinfo, getpid(), target.tid, SIGRTMIN, &info) != 0) {
+        gRequested.store(0);
+        fprintf(stderr, "Stall: failed to signal %s: %s\n", target.name, strerror(errno));
+        return;
+    }
+
+    for (unsigned i = 0; i < kSnapshotMs && gTaken.load() != seq; ++i) {
+        usleep(1000);
+    }
+
+    if (gTaken.load() != seq) {
+        // Withdraw request, late signal then finds nothing to claim. If handler has claimed it already,
+        // next snapshot is skipped until it finishes.
+        unsigned expected = seq;
+        gRequested.compare_exchange_strong(expected, 0);
+        fprintf(stderr, "Stall: no stack snapshot from %s\n", target.name);
+        return;
+    }
+
+    if (gStackDepth <= 0) {
+        fprintf(stderr, "Stall: no stack snapshot from %s\n", target.name);
+        return;
+    }
+
+    backtrace_symbols_fd(gStack, gStackDepth, STDERR_FILENO);
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include <boost/noncopyable.hpp>
+
+#include "wait_policy.h"
+
+/**
+ * \brief   Progress marker of a monitored thread.
+ *          Thread marks itself busy when it picks up a piece of work and idle when it goes back to waiting,
+ *          watchdog reports threads which stay busy for too long. Marks are a single relaxed store,
+ *          so they are cheap enough for hot loops and cost nothing more when watchdog is not running.
+ */
+class Heartbeat : boost::noncopyable
+{
+public:
+
+    Heartbeat() : m_name(NULL), m_tid(0), m_since(0), m_reported(0) {
+    }
+
+    ~Heartbeat() {
+        this->detach();
+    }
+
+    /**
+     * \brief   Start monitoring calling thread
+     *
+     * \name    Thread role shown in stall reports, must outlive the heartbeat
+     */
+    void attach(const char* name);
+
+    /**
+     * \brief   Stop monitoring
+     */
+    void detach();
+
+    void busy(uint64_t now = MonotonicUsec()) {
+        m_since.store(now, std::memory_order_relaxed);
+    }
+
+    void idle() {
+        m_since.store(0, std::memory_order_relaxed);
+    }
+
+private:
+
+    friend class Watchdog;
+
+    const char* m_name;
+    pid_t m_tid;
+    std::atomic<uint64_t> m_since;  // When current piece of work was picked up, 0 while waiting for work
+    uint64_t m_reported;            // Start of stall watchdog has reported, guarded by heartbeat registry lock
+};
+
+/**
+ * \brief   Stall detector.
+ *          Watchdog thread scans heartbeats of all attached threads. Thread which stays busy longer than
+ *          threshold is reported on stderr together with a stack snapshot taken in the thread itself
+ *          by a signal handler, and once it moves on, with the stall duration.
+ */
+class Watchdog : boost::noncopyable
+{
+public:
+
+    static const size_t kMaxFrames = 64;        // Stack snapshot depth
+    static const unsigned kSnapshotMs = 100;    // How long to wait for stalled thread to take its snapshot
+
+    struct Stats
+    {
+        uint64_t stalls;        // Stalls detected
+        uint64_t stalled;       // Threads stalled right now
+        uint64_t longestUsec;   // Longest finished stall
+    };
+
+    Watchdog() : m_threshold(0), m_sequence(0), m_stop(false) {
+    }
+
+    ~Watchdog() {
+        this->stop();
+    }
+
+    /**
+     * \brief   Start watchdog thread
+     *
+     * \thresholdMs Busy time after which thread is reported as stalled
+     *
+     * \return  0 on success, negative value on error
+     */
+    int start(unsigned thresholdMs);
+
+    void stop();
+
+    static Stats stats();
+
+private:
+
+    // Stalled thread to take stack snapshot of, copied out of heartbeat registry
+    struct Target
+    {
+        const char* name;
+        pid_t tid;
+    };
+
+    void run();
+    bool check(Heartbeat& beat, uint64_t now);
+    void snapshot(const Target& target);
+
+    uint64_t m_threshold;
+    unsigned m_sequence;        // Last snapshot requested, owned by watchdog thread
+
+    std::mutex m_lock;
+    std::condition_variable m_cond;
+    bool m_stop;                // Guarded by m_lock
+    std::thread m_thread;
+};
@@ -0,0 +1,475 @@
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include <algorithm>
+
+#include "ledsrv.h"
+#include "server.h"
+#include "worker.h"
+
+#if !defined(countof)
+#   define countof(_a) (sizeof(_a) / sizeof(_a[0]))
+#endif // countof
+
+void SessionPool::reserve()
+{
+    if (m_free.empty()) {
+        m_chunks.emplace_back(new Connection[kChunkSize]);
+
+        Connection* chunk = m_chunks.back().get();
+        for (size_t i = kChunkSize; i > 0; --i) {
+            m_free.push_back(&chunk[i - 1]);
+        }
+    }
+}
+
+Connection* SessionPool::alloc()
+{
+    this->reserve();
+
+    Connection* conn = m_free.back();
+    m_free.pop_back();
+    ++m_live;
+    return conn;
+}
+
+void SessionPool::release(Connection* conn)
+{
+    conn->close();
+    m_free.push_back(conn);
+    --m_live;
+}
+
+void SessionPool::clear()
+{
+    for (auto& chunk : m_chunks) {
+        for (size_t i = 0; i < kChunkSize; ++i) {
+            chunk[i].close();
+        }
+    }
+
+    m_free.clear();
+    m_chunks.clear();
+    m_live = 0;
+}
+
+Worker::Worker(WorkerPool& pool, unsigned spinUsec, int node)
+    : m_pool(pool), m_waiter(spinUsec), m_node(node), m_epoll(-1), m_event(-1), m_stop(false), m_busy(false)
+{
+}
+
+Worker::~Worker()
+{
+    this->stop();
+}
+
+int Worker::start()
+{
+    m_epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (m_epoll < 0) {
+        perror("epoll_create1 failed");
+        return m_epoll;
+    }
+
+    m_event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_event < 0) {
+        perror("eventfd failed");
+        return m_event;
+    }
+
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    int res = epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_event, &ev);
+    if (res != 0) {
+        perror("epoll_ctl failed");
+        return res;
+    }
+
+    m_thread = std::thread(&Worker::run, this);
+    return 0;
+}
+
+void Worker::stop()
+{
+    if (m_thread.joinable()) {
+        m_stop = true;
+        this->wake();
+        m_thread.join();
+    }
+
+    m_sessions.clear();
+
+    if (m_event >= 0) {
+        ::close(m_event);
+        m_event = -1;
+    }
+
+    if (m_epoll >= 0) {
+        ::close(m_epoll);
+        m_epoll = -1;
+    }
+}
+
+void Worker::post(const ClientId& id)
+{
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_pending.push_back(id);
+    }
+
+    this->wake();
+}
+
+void Worker::notify(Connection* conn)
+{
+    bool idle;
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        idle = m_notified.empty();
+        m_notified.push_back(conn);
+    }
+
+    // Loop takes the whole list at once, waking it up once is enough
+    if (idle) {
+        this->wake();
+    }
+}
+
+// Write out events of notified connections
+void Worker::flush()
+{
+    std::vector<Connection*> notified;
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        notified.swap(m_notified);
+    }
+
+    std::sort(notified.begin(), notified.end());
+    notified.erase(std::unique(notified.begin(), notified.end()), notified.end());
+    for (Connection* conn : notified) {
+        // Client which is behind gets its events, coalesced, once it catches up
+        if (!conn->backlogged()) {
+            this->write_events(conn);
+        }
+    }
+}
+
+void Worker::write_events(Connection* conn)
+{
+    m_events.clear();
+    TakeEvents(*conn, m_events);
+    if (m_events.empty()) {
+        return;
+    }
+
+    bool json = (conn->protocol() == Connection::kProtocolJson);
+    char line[64];
+
+    m_output.clear();
+    for (auto& event : m_events) {
+        int len = snprintf(line, sizeof(line), json ? "{\"event\":%u,\"version\":%llu}\n" : LEDSRV_EVENT " %u %llu\n",
+                           event.first, (unsigned long long)event.second);
+        m_output.append(line, len);
+    }
+
+    if (conn->write(m_output.data(), m_output.size()) != 0) {
+        this->close(conn);
+        return;
+    }
+
+    this->watch_output(conn);
+}
+
+// Client has left output unread, wait for it to make room.
+// Output fifo stays registered once it is, edge trigger only reports it when client reads after we filled it up.
+void Worker::watch_output(Connection* conn)
+{
+    if (!conn->backlogged()) {
+        return;
+    }
+
+    // Client hasn't opened output fifo yet, there is nothing to register until it does
+    if (!conn->out().is_open()) {
+        auto match = [conn](const std::pair<Connection*, uint64_t>& r) { return r.first == conn; };
+        if (std::find_if(m_readers.begin(), m_readers.end(), match) == m_readers.end()) {
+            m_readers.emplace_back(conn, MonotonicUsec() + kReaderTimeoutUsec);
+        }
+
+        return;
+    }
+
+    struct epoll_event ev = {};
+    ev.events = EPOLLOUT | EPOLLET;
+    ev.data.ptr = conn;
+    if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, conn->out().fd(), &ev) != 0 && errno != EEXIST) {
+        perror("epoll_ctl failed");
+        this->close(conn);
+    }
+}
+
+// Retry output fifos clients haven't opened yet, drop clients which don't within the timeout
+void Worker::poll_readers(uint64_t now)
+{
+    for (size_t i = 0; i < m_readers.size();) {
+        Connection* conn = m_readers[i].first;
+        if (conn->flush() != 0 || (!conn->out().is_open() && now > m_readers[i].second)) {
+            this->close(conn);
+            continue;
+        }
+
+        if (!conn->out().is_open()) {
+            ++i;
+            continue;
+        }
+
+        m_readers.erase(m_readers.begin() + i);
+        if (conn->backlogged()) {
+            this->watch_output(conn);
+        } else {
+            this->drained(conn);
+        }
+    }
+}
+
+// Backlog has been written out
+void Worker::drained(Connection* conn)
+{
+    if (!conn->in().is_open()) {
+        this->close(conn);
+        return;
+    }
+
+    this->write_events(conn);
+}
+
+// Client is done sending requests but not done reading responses, stop reading and finish writing
+void Worker::linger(Connection* conn)
+{
+    DropClient(*conn);
+    epoll_ctl(m_epoll, EPOLL_CTL_DEL, conn->in().fd(), NULL);
+    conn->in().close();
+    this->watch_output(conn);
+}
+
+void Worker::wake()
+{
+    uint64_t one = 1;
+    ::write(m_event, &one, sizeof(one));
+}
+
+size_t Worker::steal(std::vector<ClientId>& out)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    size_t count = m_pending.size() / 2;
+    if (count == 0 && m_pending.size() == 1) {
+        count = 1; // Owner is busy, last one is better off with the thief
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        out.push_back(m_pending.back());
+        m_pending.pop_back();
+    }
+
+    return count;
+}
+
+// Open connections posted since last wakeup
+void Worker::accept()
+{
+    uint64_t count;
+    ::read(m_event, &count, sizeof(count));
+
+    std::vector<ClientId> pending;
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        pending.assign(m_pending.begin(), m_pending.end());
+        m_pending.clear();
+    }
+
+    // Nothing of our own, help out busy siblings
+    if (pending.empty()) {
+        m_pool.steal(this, pending);
+    }
+
+    for (const ClientId& id : pending) {
+        Connection* conn = m_sessions.alloc();
+        if (conn->open(id) != 0) {
+            fprintf(stderr, "Failed to open connection to %d.%u\n", id.pid, id.index);
+            m_sessions.release(conn);
+            continue;
+        }
+
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.ptr = conn;
+        if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, conn->in().fd(), &ev) != 0) {
+            perror("epoll_ctl failed");
+            m_sessions.release(conn);
+            continue;
+        }
+    }
+}
+
+void Worker::close(Connection* conn)
+{
+    // Nobody can notify us about this connection after this, forget earlier notifications
+    DropClient(*conn);
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_notified.erase(std::remove(m_notified.begin(), m_notified.end(), conn), m_notified.end());
+    }
+
+    auto match = [conn](const std::pair<Connection*, uint64_t>& r) { return r.first == conn; };
+    m_readers.erase(std::remove_if(m_readers.begin(), m_readers.end(), match), m_readers.end());
+
+    if (conn->in().is_open()) {
+        epoll_ctl(m_epoll, EPOLL_CTL_DEL, conn->in().fd(), NULL);
+    }
+
+    if (conn->out().is_open()) {
+        epoll_ctl(m_epoll, EPOLL_CTL_DEL, conn->out().fd(), NULL);
+    }
+
+    m_sessions.release(conn);
+}
+
+void Worker::run()
+{
+    struct epoll_event events[64];
+
+    // Move to our node before touching any of the memory we own
+    if (m_node >= 0) {
+        m_pool.topology().bind(m_node);
+    }
+
+    m_sessions.reserve();
+    m_heartbeat.attach("worker");
+
+    while (!m_stop) {
+        m_busy = false;
+        m_heartbeat.idle();
+        if (m_waiter.wait(m_epoll, m_readers.empty() ? -1 : kReaderPollMs) < 0) {
+            perror("poll failed");
+            break;
+        }
+
+        m_busy = true;
+        uint64_t now = MonotonicUsec();
+        m_heartbeat.busy(now);
+        m_shedder.begin(now);
+
+        int count = epoll_wait(m_epoll, events, countof(events), 0);
+        for (int i = 0; i < count; ++i) {
+            Connection* conn = static_cast<Connection*>(events[i].data.ptr);
+            if (!conn) {
+                this->accept();
+                this->flush();
+                continue;
+            }
+
+            // Both fifos of a connection may be in the batch, and the connection closed by the first one
+            if (conn->id().pid == 0) {
+                continue;
+            }
+
+            // Client made room for its backlog, events held back while it was behind go out after it
+            if (events[i].events & EPOLLOUT) {
+                if (conn->flush() != 0) {
+                    this->close(conn);
+                } else if (!conn->backlogged()) {
+                    this->drained(conn);
+                }
+
+                continue;
+            }
+
+            if (!conn->in().is_open()) {
+                continue;
+            }
+
+            m_shedder.next(count - i - 1);
+            if (ProcessClient(*this, *conn)) {
+                this->watch_output(conn);
+            } else if (!conn->failed() && conn->backlogged()) {
+                this->linger(conn);
+            } else {
+                this->close(conn);
+            }
+        }
+
+        if (!m_readers.empty()) {
+            this->poll_readers(MonotonicUsec());
+        }
+    }
+
+    m_heartbeat.detach();
+}
+
+int WorkerPool::start(unsigned count, unsigned spinUsec, bool numa)
+{
+    int res = m_topology.discover();
+    if (res != 0) {
+        return res;
+    }
+
+    // Nothing to gain from pinning on a single node
+    numa = numa && (m_topology.nodes() > 1);
+
+    for (unsigned i = 0; i < count; ++i) {
+        int node = numa ? (int)(i % m_topology.nodes()) : -1;
+        m_workers.emplace_back(new Worker(*this, spinUsec, node));
+    }
+
+    for (auto& worker : m_workers) {
+        res = worker->start();
+        if (res != 0) {
+            return res;
+        }
+    }
+
+    return 0;
+}
+
+void WorkerPool::stop()
+{
+    for (auto& worker : m_workers) {
+        worker->stop();
+    }
+}
+
+void WorkerPool::post(const ClientId& id)
+{
+    Worker* target = m_workers[m_next].get();
+    m_next = (m_next + 1) % m_workers.size();
+
+    target->post(id);
+
+    // Single worker serves everything inline
+    if (!target->busy() || m_workers.size() == 1) {
+        return;
+    }
+
+    for (auto& worker : m_workers) {
+        if (!worker->busy()) {
+            worker->wake();
+            break;
+        }
+    }
+}
+
+size_t WorkerPool::steal(Worker* thief, std::vector<ClientId>& out)
+{
+    size_t count = 0;
+    for (auto& worker : m_workers) {
+        if ((worker.get() != thief) && worker->busy()) {
+            count += worker->steal(out);
+        }
+    }
+
+    return count;
+}
@@ -0,0 +1,237 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include "fifo.h"
+#include "overload.h"
+#include "topology.h"
+#include "wait_policy.h"
+#include "watchdog.h"
+
+/**
+ * \brief   Slab allocator for client connections.
+ *          Connections are carved out of fixed-size chunks and recycled through a free list,
+ *          so a large number of idle clients costs little more than their connection headers.
+ */
+class SessionPool : boost::noncopyable
+{
+public:
+
+    static const size_t kChunkSize = 256;
+
+    SessionPool() : m_live(0) {
+    }
+
+    /**
+     * \brief   Make sure there is at least one free chunk.
+     *          Called from owning thread so that chunk memory is first touched on its NUMA node.
+     */
+    void reserve();
+
+    /**
+     * \brief   Get a closed connection object
+     */
+    Connection* alloc();
+
+    /**
+     * \brief   Close connection and return it to the pool
+     */
+    void release(Connection* conn);
+
+    /**
+     * \brief   Close all live connections
+     */
+    void clear();
+
+    size_t live() const {
+        return m_live;
+    }
+
+    size_t capacity() const {
+        return m_chunks.size() * kChunkSize;
+    }
+
+private:
+
+    std::vector<std::unique_ptr<Connection[]>> m_chunks;
+    std::vector<Connection*> m_free;
+    size_t m_live;
+};
+
+class WorkerPool;
+
+/**
+ * \brief   Client connection event loop.
+ *          Acceptor hands over new client ids, worker opens their fifos and serves requests
+ *          on its own thread, multiplexing all of its connections through epoll.
+ *
+ *          Worker never blocks on a client: output client doesn't read right away stays in connection's
+ *          backlog, and worker waits for room in output fifo through epoll. Change events aren't written
+ *          to such a client until it catches up, they are coalesced per LED in the meantime, see Subscriptions.
+ *          Client which closes its input with output still in backlog keeps the connection until it reads it.
+ */
+class Worker : boost::noncopyable
+{
+public:
+
+    /**
+     * \brief   Create worker
+     *
+     * \pool        Pool this worker belongs to
+     * \spinUsec    Spin budget for worker loop wait policy
+     * \node        NUMA node to place worker thread and its memory on, negative value to leave it to the kernel
+     */
+    Worker(WorkerPool& pool, unsigned spinUsec, int node);
+    ~Worker();
+
+    /**
+     * \brief   Start worker thread
+     *
+     * \return  0 on success, negative value on error
+     */
+    int start();
+
+    /**
+     * \brief   Stop worker thread and close all of its connections
+     */
+    void stop();
+
+    /**
+     * \brief   Hand over a new client connection to this worker.
+     *          Can be called from any thread.
+     */
+    void post(const ClientId& id);
+
+    /**
+     * \brief   Tell worker that one of its connections has change events pending.
+     *          Can be called from any thread, events are taken and written from worker loop.
+     */
+    void notify(Connection* conn);
+
+    /**
+     * \brief   Wake worker up so it can look for work to steal
+     */
+    void wake();
+
+    /**
+     * \brief   Move up to a half of pending connections to another worker's queue.
+     *          Steals from the back, owner keeps taking from the front.
+     *
+     * \return  Number of stolen connections
+     */
+    size_t steal(std::vector<ClientId>& out);
+
+    /**
+     * \brief   True while worker is handling events rather than waiting for them
+     */
+    bool busy() const {
+        return m_busy;
+    }
+
+    /**
+     * \brief   Overload detector for requests served by this worker, worker thread only
+     */
+    LoadShedder& shedder() {
+        return m_shedder;
+    }
+
+private:
+
+    void run();
+    void accept();
+    void flush();
+    void write_events(Connection* conn);
+    void watch_output(Connection* conn);
+    void poll_readers(uint64_t now);
+    void drained(Connection* conn);
+    void linger(Connection* conn);
+    void close(Connection* conn);
+
+    // Time client has to open its output fifo once there is output for it
+    static const uint64_t kReaderTimeoutUsec = 2000000;
+
+    // Poll interval while some clients haven't opened their output fifo, fifo can't tell us when they do
+    static const int kReaderPollMs = 1;
+
+    WorkerPool& m_pool;
+    WaitPolicy m_waiter;
+    int m_node;
+    int m_epoll;
+    int m_event;                // eventfd to wake up the loop
+    std::thread m_thread;
+    std::atomic<bool> m_stop;
+    std::atomic<bool> m_busy;
+
+    std::mutex m_lock;
+    std::deque<ClientId> m_pending;    // Connections posted but not opened yet, guarded by m_lock
+    std::vector<Connection*> m_notified;    // Connections with pending events, guarded by m_lock
+
+    std::vector<std::pair<Connection*, uint64_t>> m_readers;    // Connections waiting for client to open output, with deadline
+    std::vector<std::pair<uint32_t, uint64_t>> m_events;    // Events being written, worker thread only
+    std::string m_output;
+
+    SessionPool m_sessions;
+    LoadShedder m_shedder;
+    Heartbeat m_heartbeat;
+};
+
+/**
+ * \brief   Set of workers sharing incoming connections.
+ *          Connections are posted round-robin. When target worker is busy, an idle sibling is woken up
+ *          to steal from its queue, so a worker stuck on a slow client does not hold back new ones.
+ */
+class WorkerPool : boost::noncopyable
+{
+public:
+
+    WorkerPool() : m_next(0) {
+    }
+
+    /**
+     * \brief   Start worker threads
+     *
+     * \count       Number of workers
+     * \spinUsec    Spin budget for worker loop wait policy
+     * \numa        Spread workers over NUMA nodes and keep their memory local
+     *
+     * \return  0 on success, negative value on error
+     */
+    int start(unsigned count, unsigned spinUsec, bool numa);
+
+    const NumaTopology& topology() const {
+        return m_topology;
+    }
+
+    /**
+     * \brief   Stop all workers
+     */
+    void stop();
+
+    /**
+     * \brief   Hand over a new client connection to the next worker.
+     *          Should be called from a single acceptor thread.
+     */
+    void post(const ClientId& id);
+
+    /**
+     * \brief   Steal pending connections from busy workers on behalf of idle thief
+     *
+     * \return  Number of stolen connections
+     */
+    size_t steal(Worker* thief, std::vector<ClientId>& out);
+
+private:
+
+    NumaTopology m_topology;
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    size_t m_next;
+};